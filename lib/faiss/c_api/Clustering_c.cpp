@@ -59,6 +59,7 @@ void faiss_ClusteringParameters_init(FaissClusteringParameters* params) {
     params->update_index = d.update_index;
     params->verbose = d.verbose;
     params->decode_block_size = d.decode_block_size;
+    params->tolerance = d.tolerance;
 }
 
 // This conversion is required because the two types are not memory-compatible
@@ -76,6 +77,7 @@ inline ClusteringParameters from_faiss_c(
     o.int_centroids = params->int_centroids;
     o.verbose = params->verbose;
     o.decode_block_size = params->decode_block_size;
+    o.tolerance = params->tolerance;
     return o;
 }
 
@@ -158,18 +160,24 @@ int faiss_kmeans_clustering(
         const float* x,
         float* centroids,
         float* weights,
-        const FaissClusteringParameters *cp
+        const FaissClusteringParameters *cp,
+        float* q_error,
+        int* iterations
 ) {
     try {
-        faiss::kmeans_clustering(
+        float obj = faiss::kmeans_clustering(
                 d,
                 n,
                 k,
                 x,
                 centroids,
                 weights,
-                from_faiss_c(cp)
+                from_faiss_c(cp),
+                iterations
         );
+        if (q_error) {
+            *q_error = obj;
+        }
         return 0;
     }
     CATCH_AND_HANDLE
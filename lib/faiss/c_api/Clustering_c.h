@@ -36,6 +36,8 @@ typedef struct FaissClusteringParameters {
 
     int seed;                 ///< seed for the random number generator
     size_t decode_block_size; ///< how many vectors at a time to decode
+
+    float tolerance; ///< convergence tolerance (0 = run all iterations)
 } FaissClusteringParameters;
 
 /// Sets the ClusteringParameters object with reasonable defaults
@@ -120,7 +122,8 @@ void faiss_Clustering_free(FaissClustering* clustering);
  * @param k nb of output centroids
  * @param x training set (size n * d)
  * @param centroids output centroids (size k * d)
- * @param q_error final quantization error
+ * @param q_error final quantization error (or NULL)
+ * @param iterations nb of iterations run (or NULL)
  * @return error code
  */
 int faiss_kmeans_clustering(
@@ -130,7 +133,9 @@ int faiss_kmeans_clustering(
         const float* x,
         float* centroids,
         float* weights,
-        const FaissClusteringParameters *params
+        const FaissClusteringParameters *params,
+        float* q_error,
+        int* iterations
 );
 
 #ifdef __cplusplus
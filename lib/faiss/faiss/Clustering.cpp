@@ -439,6 +439,8 @@ void Clustering::train_encoded(
         // k-means iterations
 
         float obj = 0;
+        float prev_obj = 0;
+        std::vector<float> prev_centroids;
         for (int i = 0; i < niter; i++) {
             double t0s = getmillisecs();
 
@@ -477,6 +479,11 @@ void Clustering::train_encoded(
                 obj += dis[j];
             }
 
+            // keep the centroids, to measure how far they move
+            if (tolerance > 0) {
+                prev_centroids = centroids;
+            }
+
             // update the centroids
             std::vector<float> hassign(k);
 
@@ -528,6 +535,24 @@ void Clustering::train_encoded(
 
             index.add(k, centroids.data());
             InterruptCallback::check();
+
+            // check for convergence
+            if (tolerance > 0) {
+                float shift = 0;
+                for (size_t j = 0; j < k; j++) {
+                    float dj = fvec_L2sqr(
+                            &centroids[j * d], &prev_centroids[j * d], d);
+                    shift = std::max(shift, dj);
+                }
+                shift = std::sqrt(shift);
+
+                bool converged = shift <= tolerance ||
+                        (i > 0 && prev_obj - obj <= tolerance * prev_obj);
+                prev_obj = obj;
+                if (converged) {
+                    break;
+                }
+            }
         }
 
         if (verbose)
@@ -591,7 +616,8 @@ float kmeans_clustering(
         const float* x,
         float* centroids,
         float* weights,
-        const ClusteringParameters& cp
+        const ClusteringParameters& cp,
+        int* iterations
 ) {
     Clustering clus(d, k, cp);
     clus.centroids = { centroids, centroids + k * d };
@@ -599,6 +625,9 @@ float kmeans_clustering(
     IndexFlatL2 index(d);
     clus.train(n, x, index, weights);
     memcpy(centroids, clus.centroids.data(), sizeof(*centroids) * d * k);
+    if (iterations) {
+        *iterations = clus.iteration_stats.size();
+    }
     return clus.iteration_stats.back().obj;
 }
 
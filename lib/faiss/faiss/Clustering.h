@@ -57,6 +57,10 @@ struct ClusteringParameters {
     /// Whether to use splitmix64-based random number generator for subsampling,
     /// which is faster, but may pick duplicate points.
     bool use_faster_subsampling = false;
+
+    /// stop iterating once the relative objective improvement, or the largest
+    /// centroid shift, of an iteration is at most this. 0 = run all iterations
+    float tolerance = 0;
 };
 
 struct ClusteringIterationStats {
@@ -199,6 +203,7 @@ struct ProgressiveDimClustering : ProgressiveDimClusteringParameters {
  * @param k nb of output centroids
  * @param x training set (size n * d)
  * @param centroids output centroids (size k * d)
+ * @param iterations output nb of iterations run (or nullptr)
  * @return final quantization error
  */
 float kmeans_clustering(
@@ -208,7 +213,8 @@ float kmeans_clustering(
         const float* x,
         float* centroids,
         float* weights,
-        const ClusteringParameters& cp
+        const ClusteringParameters& cp,
+        int* iterations = nullptr
 );
 
 } // namespace faiss
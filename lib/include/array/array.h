@@ -2,8 +2,11 @@
 
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
+#include "memory/arena.h"
+
 /*----------------------------------------------------------------------------
    patolette__Array
 
@@ -34,11 +37,21 @@ typedef struct patolette__Array {
 #define patolette__IndexMatrix2D_init(l) patolette__Array_init(l, sizeof(patolette__IndexArray*))
 #define patolette__IndexMatrix2D_destroy patolette__Array_destroy
 
+#define patolette__FloatArray patolette__Array
+#define patolette__FloatArray_index(a, i) (patolette__Array_index(float, a, i))
+#define patolette__FloatArray_destroy patolette__Array_destroy
+#define patolette__FloatArray_init(l) patolette__Array_init(l, sizeof(float))
+
 #define patolette__UInt64Array patolette__Array
 #define patolette__UInt64Array_index(a, i) (patolette__Array_index(uint64_t, a, i))
 #define patolette__UInt64Array_destroy patolette__Array_destroy
 #define patolette__UInt64Array_init(l) patolette__Array_init(l, sizeof(uint64_t))
 
+#define patolette__UInt16Array patolette__Array
+#define patolette__UInt16Array_index(a, i) (patolette__Array_index(uint16_t, a, i))
+#define patolette__UInt16Array_destroy patolette__Array_destroy
+#define patolette__UInt16Array_init(l) patolette__Array_init(l, sizeof(uint16_t))
+
 #define patolette__BoolArray patolette__Array
 #define patolette__BoolArray_index(a, i) (patolette__Array_index(bool, a, i))
 #define patolette__BoolArray_init(l) patolette__Array_init(l, sizeof(bool))
@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "memory/arena.h"
+
 /*----------------------------------------------------------------------------
    patolette__Matrix3D
 
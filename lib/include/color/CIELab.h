@@ -0,0 +1,14 @@
+#pragma once
+
+#include "color/xyz.h"
+
+#include "math/misc.h"
+
+void patolette__COLOR_sRGB_to_CIELab(
+    double r,
+    double g,
+    double b,
+    double *L,
+    double *A,
+    double *B
+);
@@ -4,6 +4,7 @@
 
 #include "math/misc.h"
 
+#include "color/kernels.h"
 #include "color/sRGB.h"
 
 void patolette__COLOR_CIELuv_to_XYZ(
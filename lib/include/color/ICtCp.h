@@ -3,6 +3,7 @@
 #include "array/matrix2D.h"
 
 #include "color/eotf.h"
+#include "color/kernels.h"
 #include "color/rec2020.h"
 #include "color/sRGB.h"
 
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+#include <omp.h>
+
+#include "array/matrix2D.h"
+
+#include "math/misc.h"
+#include "math/simd.h"
+
+// Converts count colors in place, given as their three components
+typedef void (*patolette__COLOR_Kernel)(
+    double *p0,
+    double *p1,
+    double *p2,
+    size_t count
+);
+
+void patolette__COLOR_apply_kernel(
+    patolette__Matrix2D *colors,
+    patolette__COLOR_Kernel kernel
+);
+
+void patolette__COLOR_KERNEL_sRGB_to_ICtCp(double *p0, double *p1, double *p2, size_t count);
+void patolette__COLOR_KERNEL_sRGB_to_CIELuv(double *p0, double *p1, double *p2, size_t count);
+void patolette__COLOR_KERNEL_sRGB_to_Linear_Rec2020(double *p0, double *p1, double *p2, size_t count);
+void patolette__COLOR_KERNEL_ICtCp_to_Linear_Rec2020(double *p0, double *p1, double *p2, size_t count);
+void patolette__COLOR_KERNEL_CIELuv_to_Linear_Rec2020(double *p0, double *p1, double *p2, size_t count);
+void patolette__COLOR_KERNEL_Linear_Rec2020_to_sRGB(double *p0, double *p1, double *p2, size_t count);
@@ -4,6 +4,7 @@
 
 #include "color/CIELuv.h"
 #include "color/eotf.h"
+#include "color/kernels.h"
 #include "color/sRGB.h"
 #include "color/xyz.h"
 
@@ -2,6 +2,7 @@
 
 #include "array/matrix2D.h"
 
+#include "color/kernels.h"
 #include "color/xyz.h"
 
 #include "math/misc.h"
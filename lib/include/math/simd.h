@@ -0,0 +1,150 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+/*----------------------------------------------------------------------------
+   Helpers for kernels that are vectorized with #pragma omp simd.
+
+   patolette__SIMD_CLONES marks a kernel to be compiled for several
+   instruction sets (AVX-512, AVX2 and the baseline), the best of which
+   is picked at load time, where the toolchain supports it (GCC 11+ on
+   x86-64 glibc). Elsewhere kernels are compiled for the baseline only.
+
+   The math functions below only branch through conditional expressions,
+   which GCC turns into vector selects as long as floating point
+   operations are allowed not to trap (-fno-trapping-math, check
+   CMakeLists.txt). They're defined here (static inline) so that they
+   can be inlined into each kernel clone.
+-----------------------------------------------------------------------------*/
+
+#if (                                                                     \
+    defined(__x86_64__) && defined(__GLIBC__) &&                          \
+    defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11            \
+)
+#define patolette__SIMD_CLONES \
+    __attribute__((target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
+#else
+#define patolette__SIMD_CLONES
+#endif
+
+// The math functions below are too large to be inlined by default at -O2,
+// and loops that call them wouldn't vectorize otherwise
+#if defined(__GNUC__)
+#define patolette__SIMD_INLINE static inline __attribute__((always_inline))
+#else
+#define patolette__SIMD_INLINE static inline
+#endif
+
+patolette__SIMD_INLINE double patolette__SIMD_as_double(uint64_t bits) {
+/*----------------------------------------------------------------------------
+   Reinterprets 64 bits as a double.
+
+   @params
+   bits - The bits.
+-----------------------------------------------------------------------------*/
+    double value;
+    memcpy(&value, &bits, sizeof value);
+    return value;
+}
+
+patolette__SIMD_INLINE uint64_t patolette__SIMD_as_bits(double value) {
+/*----------------------------------------------------------------------------
+   Reinterprets a double as 64 bits.
+
+   @params
+   value - The double.
+-----------------------------------------------------------------------------*/
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof bits);
+    return bits;
+}
+
+patolette__SIMD_INLINE double patolette__SIMD_log2(double x) {
+/*----------------------------------------------------------------------------
+   Calculates the base 2 logarithm of a number, to within a few ulp.
+
+   @params
+   x - The number, positive and below 2^969.
+
+   @note
+   x is split into 2^k * z, with z in [sqrt(1/2), sqrt(2)), and
+   log(z) = 2 * atanh((z - 1) / (z + 1)) is evaluated with its series.
+-----------------------------------------------------------------------------*/
+    // Scaled so that subnormals are normal too
+    x *= 0x1p54;
+
+    // 0x3fe6a09e667f3bcd is sqrt(1/2)
+    uint64_t bits = patolette__SIMD_as_bits(x);
+    uint64_t biased = (bits + (0x3ff0000000000000ULL - 0x3fe6a09e667f3bcdULL)) >> 52;
+    double z = patolette__SIMD_as_double(bits - ((biased - 1023) << 52));
+    double k = (
+        patolette__SIMD_as_double(0x4330000000000000ULL | biased) -
+        (0x1p52 + 1023 + 54)
+    );
+
+    double s = (z - 1) / (z + 1);
+    double s2 = s * s;
+    double p = 1.0 / 21;
+    p = p * s2 + 1.0 / 19;
+    p = p * s2 + 1.0 / 17;
+    p = p * s2 + 1.0 / 15;
+    p = p * s2 + 1.0 / 13;
+    p = p * s2 + 1.0 / 11;
+    p = p * s2 + 1.0 / 9;
+    p = p * s2 + 1.0 / 7;
+    p = p * s2 + 1.0 / 5;
+    p = p * s2 + 1.0 / 3;
+    double ln_z = 2 * s + 2 * s * s2 * p;
+
+    return k + ln_z * 1.4426950408889634;
+}
+
+patolette__SIMD_INLINE double patolette__SIMD_exp2(double t) {
+/*----------------------------------------------------------------------------
+   Calculates 2 raised to a number, to within a few ulp.
+
+   @params
+   t - The exponent, below 1023. Results under 2^-1021 are flushed to 0.
+
+   @note
+   t is split into n + r, with n an integer and r in [-1/2, 1/2], and
+   2^r = e^(r * ln(2)) is evaluated with its Taylor series.
+-----------------------------------------------------------------------------*/
+    // Rounds t to the nearest integer, which ends up in the low bits
+    double shifted = t + 0x1.8p52;
+    uint64_t n = patolette__SIMD_as_bits(shifted) - patolette__SIMD_as_bits(0x1.8p52);
+    double u = (t - (shifted - 0x1.8p52)) * 0.6931471805599453;
+
+    double p = 1.0 / 6227020800;
+    p = p * u + 1.0 / 479001600;
+    p = p * u + 1.0 / 39916800;
+    p = p * u + 1.0 / 3628800;
+    p = p * u + 1.0 / 362880;
+    p = p * u + 1.0 / 40320;
+    p = p * u + 1.0 / 5040;
+    p = p * u + 1.0 / 720;
+    p = p * u + 1.0 / 120;
+    p = p * u + 1.0 / 24;
+    p = p * u + 1.0 / 6;
+    p = p * u + 0.5;
+    p = p * u + 1;
+    p = p * u + 1;
+
+    double result = patolette__SIMD_as_double(patolette__SIMD_as_bits(p) + (n << 52));
+    return t < -1021 ? 0 : result;
+}
+
+patolette__SIMD_INLINE double patolette__SIMD_pow(double x, double y) {
+/*----------------------------------------------------------------------------
+   Calculates x raised to y, for y > 0.
+
+   @params
+   x - The base. Negative bases give NaN, as with pow.
+   y - The exponent, positive.
+-----------------------------------------------------------------------------*/
+    double result = patolette__SIMD_exp2(y * patolette__SIMD_log2(fabs(x)));
+    result = x > 0 ? result : 0;
+    return x >= 0 ? result : NAN;
+}
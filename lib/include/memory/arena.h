@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+/*----------------------------------------------------------------------------
+   patolette__ARENA
+
+   Allocation of temporaries. Between patolette__ARENA_begin and
+   patolette__ARENA_end (a scope), the calling thread's small allocations
+   are served from its own bump arena and freeing them is a no-op; all of
+   them are released at once when the scope ends. Scopes nest, and are
+   per thread. Outside of a scope, and for large allocations, the heap is
+   used.
+
+   Memory from patolette__ARENA_malloc / patolette__ARENA_calloc must
+   only be released with patolette__ARENA_free.
+-----------------------------------------------------------------------------*/
+
+void patolette__ARENA_begin(void);
+void patolette__ARENA_end(void);
+
+void *patolette__ARENA_malloc(size_t size);
+void *patolette__ARENA_calloc(size_t count, size_t size);
+void patolette__ARENA_free(void *ptr);
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "patolette.h"
+
+#include "array/matrix2D.h"
+
+/*----------------------------------------------------------------------------
+    Backend interfaces for the engines the pipeline delegates to: nearest
+    neighbour search (palette mapping and dithering) and KMeans (palette
+    refinement).
+
+    Each backend is a table of functions. Backends are looked up at run
+    time from the engine selected in patolette__QuantizationOptions, so
+    that engines can be added (or compiled out) without touching the
+    pipeline.
+-----------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------
+    patolette__NNBackend
+
+    Nearest neighbour search over a color palette. An index is built once
+    per palette, queried any number of times, and then destroyed.
+-----------------------------------------------------------------------------*/
+
+typedef struct patolette__NNBackend {
+    // A human readable name, for logging
+    const char *name;
+
+    // Builds an index from a palette, each coordinate scaled by fx, fy, fz
+    void *(*build_index)(
+        const patolette__Matrix2D *palette,
+        double fx,
+        double fy,
+        double fz
+    );
+
+    // Finds the closest palette color to a (scaled) color
+    size_t (*find_closest)(void *index, double x, double y, double z);
+
+    // Maps each color in a list to its closest palette color
+    void (*find_closest_batch)(
+        void *index,
+        const patolette__Matrix2D *colors,
+        size_t *palette_map
+    );
+
+    void (*destroy_index)(void *index);
+} patolette__NNBackend;
+
+/*----------------------------------------------------------------------------
+    patolette__RefineBackend
+
+    KMeans over weighted 3D points, starting from a set of centers. Both
+    centers and samples are row-major floats, i.e [x0, y0, z0, x1, ...].
+-----------------------------------------------------------------------------*/
+
+typedef struct patolette__KMeansParameters {
+    // Maximum number of iterations (or batches)
+    int niter;
+
+    // Convergence tolerance, <= 0 runs all iterations
+    double tolerance;
+
+    // Number of samples in each batch, for mini-batch engines
+    size_t batch_size;
+
+    // Maximum number of samples to use
+    size_t max_samples;
+
+    bool verbose;
+} patolette__KMeansParameters;
+
+typedef struct patolette__RefineBackend {
+    // A human readable name, for logging
+    const char *name;
+
+    // Runs KMeans, leaving the final centers in centers
+    void (*refine)(
+        float *centers,
+        const float *samples,
+        const float *weights,
+        size_t center_count,
+        size_t sample_count,
+        const patolette__KMeansParameters *params,
+        int *iterations,
+        double *objective
+    );
+} patolette__RefineBackend;
@@ -2,4 +2,4 @@
 
 #include "quantize/cluster.h"
 
-patolette__Matrix2D *patolette__PALETTE_create(const patolette__ColorClusterArray *clusters);
\ No newline at end of file
+patolette__Matrix2D *patolette__PALETTE_create(const patolette__ClusterTable *table);
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+
+#include "math/misc.h"
+
+#include "memory/arena.h"
+
+void patolette__KMEANS_hamerly(
+    float *centers,
+    const float *samples,
+    const float *weights,
+    size_t center_count,
+    size_t sample_count,
+    int niter,
+    double tolerance,
+    bool verbose,
+    int *iterations,
+    double *objective
+);
+
+void patolette__KMEANS_minibatch(
+    float *centers,
+    const float *samples,
+    const float *weights,
+    size_t center_count,
+    size_t sample_count,
+    size_t batch_size,
+    int niter,
+    double tolerance,
+    bool verbose,
+    int *iterations,
+    double *objective
+);
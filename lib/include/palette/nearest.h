@@ -1,32 +1,29 @@
 #pragma once
 
+#include <math.h>
+#include <stdlib.h>
+#include <omp.h>
+
+#ifdef PATOLETTE_WITH_FLANN
 #include "flann/flann.h"
+#endif
+
+#include "patolette.h"
 
 #include "array/matrix2D.h"
 
-flann_index_t patolette__PALETTE_build_palette_index(
-    const patolette__Matrix2D *colors,
-    double fx,
-    double fy,
-    double fz,
-    struct FLANNParameters *params
-);
+#include "math/misc.h"
 
-size_t patolette__PALETTE_find_closest(
-    double x,
-    double y,
-    double z,
-    flann_index_t index,
-    struct FLANNParameters *params
-);
+#include "memory/arena.h"
+
+#include "palette/backend.h"
+
+const patolette__NNBackend *patolette__PALETTE_get_nn_backend(patolette__NNEngine engine);
 
 void patolette__PALETTE_fill_palette_map_nearest(
     const patolette__Matrix2D *colors,
     const patolette__Matrix2D *palette_colors,
+    const patolette__NNBackend *backend,
     size_t *palette_map
 );
 
-patolette__Vector *patolette__PALETTE_get_knn_total_distances(
-    const patolette__Matrix2D *colors,
-    size_t k
-);
\ No newline at end of file
@@ -1,15 +1,37 @@
 #pragma once
 
+#ifdef PATOLETTE_WITH_FAISS
 #include "faiss/c_api/Clustering_c.h"
+#endif
+
+#include "patolette.h"
+
+#include "memory/arena.h"
+
+#include "palette/backend.h"
+#include "palette/create.h"
+#include "palette/kmeans.h"
 
 #include "quantize/cluster.h"
 #include "quantize/local.h"
+#include "quantize/weights.h"
+
+const patolette__RefineBackend *patolette__PALETTE_get_refine_backend(
+    patolette__KMeansEngine engine
+);
+
+patolette__Matrix2D *patolette__PALETTE_refine(
+    const patolette__Matrix2D *colors,
+    const patolette__Weights *weights,
+    const patolette__Matrix2D *initial,
+    const patolette__RefineBackend *backend,
+    const patolette__KMeansParameters *params
+);
 
 patolette__Matrix2D *patolette__PALETTE_get_refined_palette(
     const patolette__Matrix2D *colors,
-    const patolette__Vector *weights,
-    const patolette__ColorClusterArray *clusters,
-    int niter,
-    size_t max_samples,
-    bool verbose
-);
\ No newline at end of file
+    const patolette__Weights *weights,
+    const patolette__ClusterTable *table,
+    const patolette__RefineBackend *backend,
+    const patolette__KMeansParameters *params
+);
@@ -10,15 +10,134 @@ typedef enum patolette__ColorSpace {
     patolette__ICtCp
 } patolette__ColorSpace;
 
+typedef enum patolette__KMeansEngine {
+    patolette__KMeansFAISS,
+    patolette__KMeansHamerly,
+    patolette__KMeansMiniBatch
+} patolette__KMeansEngine;
+
+typedef enum patolette__NNEngine {
+    patolette__NNFLANN,
+    patolette__NNNative
+} patolette__NNEngine;
+
+typedef enum patolette__Weighting {
+    patolette__WeightingSaliency,
+    patolette__WeightingDensity
+} patolette__Weighting;
+
 typedef struct patolette__QuantizationOptions {
     bool dither;
     bool palette_only;
     patolette__ColorSpace color_space;
+    patolette__Weighting weighting;
+    double tile_size;
+    size_t saliency_max_side;
     int kmeans_niter;
+    patolette__KMeansEngine kmeans_engine;
+    double kmeans_tolerance;
+    size_t kmeans_batch_size;
     size_t kmeans_max_samples;
+    double split_batch_ratio;
+    size_t generation_max_samples;
+    size_t pyramid_max_pixels;
+    int histogram_bits;
+    double target_distortion;
+    patolette__NNEngine nn_engine;
     bool verbose;
 } patolette__QuantizationOptions;
 
+/**
+ * The split hierarchy of a palette. Entries [0, base_count) come from the
+ * global stage; split s then split entry split_index[s] in two, the new entry
+ * being base_count + s. Palettes of any size in the range
+ * [base_count, base_count + split_count] can be extracted from it.
+ */
+typedef struct patolette__PaletteHierarchy {
+    // The number of palette entries before any split
+    size_t base_count;
+
+    // The number of splits
+    size_t split_count;
+
+    // The entry each split was made on (palette_size entries)
+    size_t *split_index;
+
+    // The color of the split entry before each split, in the same space as
+    // the palette (sRGB[0, 1], or with palette_only the color space used for
+    // palette generation), as a (palette_size, 3) column-major matrix
+    double *split_color;
+} patolette__PaletteHierarchy;
+
+typedef enum patolette__WeightMapKind {
+    patolette__WeightsDense,
+    patolette__WeightsGrid,
+    patolette__WeightsUInt8,
+    patolette__WeightsUInt16,
+    patolette__WeightsRegions
+} patolette__WeightMapKind;
+
+typedef enum patolette__WeightRegionShape {
+    patolette__RegionRectangle,
+    patolette__RegionEllipse
+} patolette__WeightRegionShape;
+
+/**
+ * A region of an image whose colors are weighted up. Coordinates are in
+ * pixels, a pixel being inside when its center is. Ellipses are the ones
+ * inscribed in the region's box.
+ */
+typedef struct patolette__WeightRegion {
+    patolette__WeightRegionShape shape;
+
+    // The top-left corner of the region's box
+    double x;
+    double y;
+
+    // The size of the region's box
+    double width;
+    double height;
+
+    // The factor the weight of the colors inside is multiplied by
+    double boost;
+} patolette__WeightRegion;
+
+/**
+ * The weight of each color of an image, possibly described compactly.
+ * Weights are evaluated where they're used. Compact maps are never expanded
+ * to one double per pixel; palette generation only keeps a single precision
+ * copy of the weight of each color it works on (pixels, unless sampling,
+ * downscaling or binning reduce them). All weights are expected to be in the
+ * range [1, inf].
+ *
+ *  - patolette__WeightsDense: data holds width * height doubles.
+ *  - patolette__WeightsGrid: data holds a (grid_height, grid_width) row-major grid of
+ *                            doubles, bilinearly sampled at each pixel (cell and pixel
+ *                            centers aligned). Cells are grid_cell_size pixels wide and
+ *                            tall, or when that's 0, the grid is stretched over the image.
+ *  - patolette__WeightsUInt8 / patolette__WeightsUInt16: data holds width * height
+ *                            uint8_t / uint16_t values q, each weighing 1 + scale * q.
+ *  - patolette__WeightsRegions: data holds region_count regions. Each color weighs the
+ *                            product of the boosts of the regions it's in (1 if none).
+ */
+typedef struct patolette__WeightMap {
+    patolette__WeightMapKind kind;
+    const void *data;
+
+    // The dimensions of a grid map
+    size_t grid_width;
+    size_t grid_height;
+
+    // The size of a grid map's cells, in pixels, or 0
+    double grid_cell_size;
+
+    // The scale of a quantized map
+    double scale;
+
+    // The number of regions of a region map
+    size_t region_count;
+} patolette__WeightMap;
+
 void patolette(
     size_t width,
     size_t height,
@@ -31,5 +150,47 @@ void patolette(
     int *exit_code
 );
 
+void patolette_with_weight_map(
+    size_t width,
+    size_t height,
+    const double *data,
+    const patolette__WeightMap *weight_map,
+    size_t palette_size,
+    const patolette__QuantizationOptions *options,
+    double *palette,
+    size_t *palette_map,
+    size_t *result_size,
+    patolette__PaletteHierarchy *hierarchy,
+    int *exit_code
+);
+
 const char *get_patolette_exit_code_info_message(int exit_code);
-patolette__QuantizationOptions *patolette_create_default_options();
\ No newline at end of file
+patolette__QuantizationOptions *patolette_create_default_options();
+
+void patolette_with_hierarchy(
+    size_t width,
+    size_t height,
+    const double *data,
+    const double *weights,
+    size_t palette_size,
+    const patolette__QuantizationOptions *options,
+    double *palette,
+    size_t *palette_map,
+    size_t *result_size,
+    patolette__PaletteHierarchy *hierarchy,
+    int *exit_code
+);
+
+bool patolette_hierarchy_extract_palette(
+    const patolette__PaletteHierarchy *hierarchy,
+    const double *palette,
+    size_t palette_size,
+    size_t size,
+    double *sub_palette
+);
+
+bool patolette_hierarchy_get_remap(
+    const patolette__PaletteHierarchy *hierarchy,
+    size_t size,
+    size_t *remap
+);
\ No newline at end of file
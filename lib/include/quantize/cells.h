@@ -1,6 +1,10 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <omp.h>
 
 #include "array/array.h"
 #include "array/matrix2D.h"
@@ -10,20 +14,88 @@
 #include "math/eigen.h"
 #include "math/pca.h"
 
+#include "memory/arena.h"
+
+#include "quantize/sort.h"
+
 typedef struct patolette__CellMomentsCache {
-    patolette__UInt64Array *w0;
+    patolette__Vector *w0;
     patolette__Matrix2D *w1;
     patolette__Vector *w2;
     patolette__Matrix3D *wrs;
     size_t size;
 } patolette__CellMomentsCache;
 
+/*----------------------------------------------------------------------------
+    patolette__CellQueryCache
+
+    A small hash table keyed by cell (a, b) that memoizes the results of
+    cell queries (distortion, principal axis and bias), so that cells
+    that show up again in later quantizers cost a single lookup.
+-----------------------------------------------------------------------------*/
+
+typedef struct patolette__CellQuery {
+    // The lower end of the cell
+    size_t a;
+
+    // The upper end of the cell
+    size_t b;
+
+    // The cell's distortion
+    double distortion;
+
+    // The cell's principal axis (only valid if has_bias is true)
+    double axis[3];
+
+    // The cell's bias towards the axis the cache was created with
+    // (only valid if has_bias is true)
+    double bias;
+
+    // Whether the axis and bias have been evaluated
+    bool has_bias;
+} patolette__CellQuery;
+
+typedef struct patolette__CellQueryCache {
+    // Query results, in insertion order
+    patolette__CellQuery *queries;
+
+    // Number of query results
+    size_t length;
+
+    // Capacity of the query results array
+    size_t capacity;
+
+    // Open addressing table of (index + 1) into queries, 0 if empty
+    size_t *table;
+
+    // Size of the table (always a power of two)
+    size_t table_size;
+} patolette__CellQueryCache;
+
 void patolette__CellMomentsCache_destroy(patolette__CellMomentsCache *cache);
 
+void patolette__CellQueryCache_destroy(patolette__CellQueryCache *queries);
+patolette__CellQueryCache *patolette__CellQueryCache_init(size_t capacity);
+size_t patolette__CellQueryCache_get(
+    patolette__CellQueryCache *queries,
+    size_t a,
+    size_t b,
+    const patolette__CellMomentsCache *cache
+);
+
+bool patolette__CELLS_evaluate_query_bias(
+    patolette__CellQuery *query,
+    const patolette__Vector *axis,
+    const patolette__CellMomentsCache *cache
+);
+
 patolette__CellMomentsCache *patolette__CELLS_preprocess(
     const patolette__Matrix2D *colors,
-    const patolette__IndexArray *bucket_map,
-    size_t bucket_count
+    const patolette__Vector *weights,
+    const patolette__Vector *scatter,
+    const patolette__Vector *axis,
+    size_t bucket_count,
+    patolette__UInt16Array **bucket_map
 );
 
 double patolette__CELLS_get_cell_distortion(
@@ -2,6 +2,8 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <omp.h>
 
 #include "array/array.h"
 
@@ -9,78 +11,137 @@
 #include "math/pca.h"
 
 /*----------------------------------------------------------------------------
-    patolette__ColorCluster
+    patolette__ClusterBuffer
 
-    A simple cluster of colors.
+    The working buffer color clusters are ranges of. It holds a permuted
+    copy of the color set, so that the colors of any cluster are contiguous.
 -----------------------------------------------------------------------------*/
 
-// Macros for color cluster arrays
-#define patolette__ColorClusterArray patolette__Array
-#define patolette__ColorClusterArray_index(a, i) (patolette__Array_index(patolette__ColorCluster*, a, i))
-#define patolette__ColorClusterArray_init(l) patolette__Array_init(l, sizeof(patolette__ColorCluster*))
-#define patolette__ColorClusterArray_copy_into patolette__Array_copy_into
-#define patolette__ColorClusterArray_slice patolette__Array_slice
-#define patolette__ColorClusterArray_destroy patolette__Array_destroy
-
-typedef struct patolette__ColorCluster patolette__ColorCluster;
-struct patolette__ColorCluster {
-    // The cluster's distortion
-    double _distortion;
-
-    // The cluster's principal axis
-    patolette__Vector *_principal_axis;
-
-    // The cluster's colors
-    patolette__Matrix2D *_colors;
-
-    // The cluster's center (mean)
-    patolette__Vector *_center;
-
-    /*----------------------------------------------------------------------------
-        The indices of the cluster's colors in the dataset.
-
-        @example
-        If dataset__NOTOWNED__ = | 1 2 3 |
-                                 | 3 0 0 |
-                                 | 2 2 2 |
-
-           _indices = | 0, 1 | then
-
-           _colors = | 1 2 3 |
-                     | 3 0 0 |
-    -----------------------------------------------------------------------------*/
-    patolette__IndexArray *indices;
-
-    // The weight of each color
-    patolette__Vector  *weights;
-
-    // Size of the cluster, matches the length of indices
-    size_t size;
-
-    // The dataset the cluster belongs to
-    // This property is not owned by the cluster, and so
-    // it must be destroyed separately
-    const patolette__Matrix2D  *dataset__NOTOWNED__;
-
-    // The weights of each sample in the dataset
-    // This property is not owned by the cluster, and so
-    // it must be destroyed separately
-    const patolette__Vector  *dataset_weights__NOTOWNED__;
-};
-
-void patolette__ColorCluster_destroy(patolette__ColorCluster *cluster);
-patolette__ColorCluster *patolette__ColorCluster_init(
-    const patolette__Matrix2D *dataset,
-    const patolette__Vector *weights,
-    patolette__IndexArray *indices
+typedef struct patolette__ClusterBuffer {
+    // The permuted colors
+    patolette__Matrix2D *colors;
+
+    // The permuted weights, NULL if colors are not weighted. Kept in
+    // single precision (as for KMeans refinement), to halve their size.
+    patolette__FloatArray *weights;
+
+    // The permuted (weighted) scatter of the colors each color stands
+    // for, e.g. when colors are histogram bins. NULL if colors are exact.
+    patolette__Vector *scatter;
+
+    // Scratch space for bucket ids, shared by all clusters
+    patolette__UInt16Array *buckets;
+} patolette__ClusterBuffer;
+
+void patolette__ClusterBuffer_destroy(patolette__ClusterBuffer *buffer);
+patolette__ClusterBuffer *patolette__ClusterBuffer_init(
+    size_t size,
+    bool weighted,
+    bool scattered
+);
+
+/*----------------------------------------------------------------------------
+    patolette__ClusterTable
+
+    A flat (struct of arrays) table of color clusters. Each cluster is a
+    node, identified by its index in the table. Nodes are never removed:
+    when a cluster is split, its children are appended as new nodes and
+    linked to it, so the table also records the splitting hierarchy.
+
+    The clusters that currently make up the quantization are listed in
+    the live index.
+
+    @example
+    If the buffer's colors = | 1 2 3 |
+                             | 3 0 0 |
+                             | 2 2 2 |
+
+       and node 0 = [0, 3) was split into node 1 = [0, 1) and
+       node 2 = [1, 3), then live = | 1, 2 |
+-----------------------------------------------------------------------------*/
+
+// Marks a missing link (no parent, or no children)
+#define patolette__CLUSTER_NONE SIZE_MAX
+
+typedef struct patolette__ClusterTable {
+    // The range [begin, end) of each cluster's colors in the buffer
+    patolette__IndexArray *begin;
+    patolette__IndexArray *end;
+
+    // The sum of the weights of each cluster's colors
+    patolette__Vector *weight;
+
+    // The center (mean) of each cluster, one row per node
+    patolette__Matrix2D *center;
+
+    // The principal axis of each cluster, one row per node
+    patolette__Matrix2D *axis;
+
+    // The distortion of each cluster
+    patolette__Vector *distortion;
+
+    // Whether the center, weight, distortion (and axis) were computed
+    patolette__BoolArray *has_stats;
+
+    // Whether the principal axis could be computed
+    patolette__BoolArray *has_axis;
+
+    // Links to each cluster's parent and children
+    patolette__IndexArray *parent;
+    patolette__IndexArray *left;
+    patolette__IndexArray *right;
+
+    // Number of nodes in use
+    size_t count;
+
+    // Number of nodes the table can hold
+    size_t capacity;
+
+    // The nodes of the clusters that make up the quantization
+    patolette__IndexArray *live;
+
+    // The number of live clusters
+    size_t length;
+
+    // The clusters split by the local stage, in split order, along with
+    // the live slot each one was at. Check patolette__LQ_quantize.
+    patolette__IndexArray *split_nodes;
+    patolette__IndexArray *split_slots;
+
+    // The number of splits
+    size_t split_count;
+
+    // The buffer all clusters are ranges of (owned)
+    patolette__ClusterBuffer *buffer;
+} patolette__ClusterTable;
+
+#define patolette__ClusterTable_size(t, n) (                \
+    patolette__IndexArray_index((t)->end, n) -              \
+    patolette__IndexArray_index((t)->begin, n)              \
+)
+
+#define patolette__ClusterTable_live(t, i) (patolette__IndexArray_index((t)->live, i))
+
+void patolette__ClusterTable_destroy(patolette__ClusterTable *table);
+patolette__ClusterTable *patolette__ClusterTable_init(
+    patolette__ClusterBuffer *buffer,
+    size_t capacity
+);
+
+size_t patolette__ClusterTable_reserve(patolette__ClusterTable *table, size_t count);
+void patolette__ClusterTable_set(
+    patolette__ClusterTable *table,
+    size_t node,
+    size_t begin,
+    size_t end,
+    size_t parent
 );
 
-const patolette__Vector *patolette__ColorCluster_get_weights(patolette__ColorCluster *cluster);
-double patolette__ColorCluster_get_distortion(patolette__ColorCluster *cluster);
-double patolette__ColorCluster_get_variance(patolette__ColorCluster *cluster);
-const patolette__Vector *patolette__ColorCluster_get_center(patolette__ColorCluster *cluster);
-const patolette__Vector *patolette__ColorCluster_get_principal_axis(patolette__ColorCluster *cluster);
-const patolette__Matrix2D *patolette__ColorCluster_get_colors(patolette__ColorCluster *cluster);
+void patolette__ClusterTable_compute_stats(patolette__ClusterTable *table, size_t node);
+double patolette__ClusterTable_get_distortion(patolette__ClusterTable *table, size_t node);
 
-// TODO: refactor, weird placement
-void patolette__ColorClusterArray_destroy_deep(patolette__ColorClusterArray *array);
\ No newline at end of file
+size_t patolette__ClusterTable_partition(
+    patolette__ClusterTable *table,
+    size_t node,
+    size_t split_bucket
+);
@@ -12,9 +12,12 @@
 #include "quantize/sort.h"
 #include "quantize/cluster.h"
 #include "quantize/cells.h"
+#include "quantize/weights.h"
 
-patolette__ColorClusterArray *patolette__GQ_quantize(
+patolette__ClusterTable *patolette__GQ_quantize(
     const patolette__Matrix2D *colors,
-    const patolette__Vector *weights,
+    const patolette__Weights *weights,
+    const patolette__Vector *scatter,
+    bool weighted,
     size_t palette_size
 );
\ No newline at end of file
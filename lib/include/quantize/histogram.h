@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <omp.h>
+
+#include "array/matrix2D.h"
+#include "array/vector.h"
+
+#include "math/misc.h"
+
+#include "quantize/weights.h"
+
+patolette__Matrix2D *patolette__HISTOGRAM_bin(
+    const patolette__Matrix2D *colors,
+    const patolette__Weights *weights,
+    int bits,
+    patolette__Vector **bin_weights,
+    patolette__Vector **bin_scatter
+);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <math.h>
 #include <stddef.h>
 
 #include "array/matrix2D.h"
@@ -9,8 +10,10 @@
 #include "quantize/cluster.h"
 #include "quantize/sort.h"
 
-patolette__ColorClusterArray *patolette__LQ_quantize(
-    patolette__ColorClusterArray *clusters,
+void patolette__LQ_quantize(
+    patolette__ClusterTable *table,
     size_t palette_size,
+    double batch_ratio,
+    double target_distortion,
     bool verbose
 );
\ No newline at end of file
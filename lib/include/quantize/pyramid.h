@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+#include <omp.h>
+
+#include "array/matrix2D.h"
+#include "array/vector.h"
+
+#include "color/sRGB.h"
+
+#include "math/misc.h"
+
+#include "quantize/weights.h"
+
+patolette__Matrix2D *patolette__PYRAMID_downscale(
+    const patolette__Matrix2D *colors,
+    const patolette__Weights *weights,
+    size_t width,
+    size_t height,
+    size_t max_pixels,
+    size_t *level_width,
+    size_t *level_height,
+    patolette__Vector **level_weights
+);
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <omp.h>
+
+#include "array/matrix2D.h"
+#include "array/vector.h"
+
+#include "math/misc.h"
+
+#include "quantize/weights.h"
+
+patolette__Matrix2D *patolette__SAMPLE_stratified(
+    const patolette__Matrix2D *colors,
+    const patolette__Weights *weights,
+    size_t width,
+    size_t height,
+    size_t max_samples,
+    patolette__Vector **sample_weights
+);
@@ -10,8 +10,86 @@
 #include "math/linalg.h"
 #include "math/misc.h"
 
-patolette__IndexArray *patolette__SORT_axis_sort(
-    const patolette__Matrix2D *colors,
+/*----------------------------------------------------------------------------
+   patolette__AxisBucketing
+
+   Describes how colors are bucketed based on their projection onto an
+   axis. Check patolette__SORT_bucket.
+
+   Bucket ids are stored as uint16_t, so bucket_count can't go over 65536.
+-----------------------------------------------------------------------------*/
+
+typedef struct patolette__AxisBucketing {
+    // The axis colors are projected onto
+    double axis[3];
+
+    // The lowest projection found
+    double low;
+
+    // 1 / (highest projection - lowest projection), or 0 if all
+    // projections (almost) coincide
+    double scale;
+
+    // The number of buckets
+    size_t bucket_count;
+} patolette__AxisBucketing;
+
+static inline size_t patolette__SORT_bucket(
+    const patolette__AxisBucketing *bucketing,
+    size_t i,
+    double cx,
+    double cy,
+    double cz
+) {
+/*----------------------------------------------------------------------------
+   Gets the bucket for the i-th color of a list of colors.
+
+   @params
+   bucketing - The bucketing description.
+   i - The index of the color in the list.
+   cx - The x coordinate of the color.
+   cy - The y coordinate of the color.
+   cz - The z coordinate of the color.
+
+   @note
+   If all projections (almost) coincide, buckets are just assigned
+   incrementally. This might be very stupid. Maybe it's better to
+   switch between the first and last bucket, but most likely it will
+   never matter.
+-----------------------------------------------------------------------------*/
+    size_t bucket_count = bucketing->bucket_count;
+
+    if (bucketing->scale == 0) {
+        return i % bucket_count;
+    }
+
+    double dot = (
+        cx * bucketing->axis[0] +
+        cy * bucketing->axis[1] +
+        cz * bucketing->axis[2]
+    );
+
+    // Clamped, projections may be recomputed with slightly different rounding
+    double ratio = fmax(0, (dot - bucketing->low) * bucketing->scale);
+    size_t bucket = (size_t)((double)bucket_count * ratio);
+    return min(bucket, bucket_count - 1);
+}
+
+patolette__AxisBucketing patolette__SORT_get_bucketing(
+    const double *cx,
+    const double *cy,
+    const double *cz,
+    size_t length,
     const patolette__Vector *axis,
     size_t bucket_count
+);
+
+void patolette__SORT_axis_sort(
+    const double *cx,
+    const double *cy,
+    const double *cz,
+    size_t length,
+    const patolette__Vector *axis,
+    size_t bucket_count,
+    uint16_t *buckets
 );
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "patolette.h"
+
+#include "array/array.h"
+#include "array/vector.h"
+
+#include "math/misc.h"
+
+#include "memory/arena.h"
+
+/*----------------------------------------------------------------------------
+    patolette__Weights
+
+    The weight of each color of a color set, evaluated on demand from a
+    weight map (check patolette__WeightMap), so compact maps are never
+    expanded to one weight per color.
+
+    Colors are addressed by index. For images, color i is the pixel at
+    (i % width, i / width); plain color sets (e.g. samples or histogram
+    bins) are dense maps of height 1.
+-----------------------------------------------------------------------------*/
+
+typedef struct patolette__Weights {
+    // The map weights are evaluated from. Its data is borrowed, unless
+    // it points into owned.
+    patolette__WeightMap map;
+
+    // The dimensions of the image the map is evaluated for
+    size_t width;
+    size_t height;
+
+    // Storage owned by the weights, or NULL
+    patolette__Array *owned;
+} patolette__Weights;
+
+void patolette__Weights_destroy(patolette__Weights *weights);
+patolette__Weights *patolette__Weights_init(
+    const patolette__WeightMap *map,
+    size_t width,
+    size_t height,
+    patolette__Array *owned
+);
+
+patolette__Weights *patolette__Weights_from_vector(patolette__Vector *weights);
+
+bool patolette__Weights_is_valid_map(const patolette__WeightMap *map);
+double patolette__Weights_get(const patolette__Weights *weights, size_t i);
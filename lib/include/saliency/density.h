@@ -0,0 +1,26 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <omp.h>
+
+#include "array/array.h"
+#include "array/matrix2D.h"
+#include "array/vector.h"
+
+#include "color/CIELab.h"
+
+#include "math/misc.h"
+
+#include "memory/arena.h"
+
+#include "quantize/weights.h"
+
+patolette__Weights *patolette__DENSITY_weights(
+    const patolette__Matrix2D *colors,
+    size_t width,
+    size_t height,
+    double tile_size
+);
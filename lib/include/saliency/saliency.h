@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <omp.h>
+
+#include "array/matrix2D.h"
+#include "array/vector.h"
+
+#include "color/CIELab.h"
+
+#include "math/misc.h"
+
+#include "memory/arena.h"
+
+#include "quantize/weights.h"
+
+patolette__Weights *patolette__SALIENCY_weights(
+    const patolette__Matrix2D *colors,
+    size_t width,
+    size_t height,
+    double tile_size,
+    size_t max_side
+);
@@ -24,8 +24,8 @@ void patolette__Array_destroy(patolette__Array *array) {
         return;
     }
 
-    free(array->data);
-    free(array);
+    patolette__ARENA_free(array->data);
+    patolette__ARENA_free(array);
 }
 
 patolette__Array *patolette__Array_init(size_t length, size_t item_size) {
@@ -37,8 +37,8 @@ patolette__Array *patolette__Array_init(size_t length, size_t item_size) {
    length - The length of the array.
    item_size - The size of each item, in bytes.
 -----------------------------------------------------------------------------*/
-    patolette__Array *array = malloc(sizeof *array);
-    array->data = calloc(length, item_size);
+    patolette__Array *array = patolette__ARENA_malloc(sizeof *array);
+    array->data = patolette__ARENA_calloc(length, item_size);
     array->length = length;
     array->item_size = item_size;
     return array;
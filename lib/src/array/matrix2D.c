@@ -36,7 +36,7 @@ static patolette__Matrix2D *patolette__Matrix2D_init_base(size_t rows, size_t co
    I can't remember why I split initialization into init_base and
    init_data (maybe reads easier?).
 -----------------------------------------------------------------------------*/
-    patolette__Matrix2D *m = malloc(sizeof *m);
+    patolette__Matrix2D *m = patolette__ARENA_malloc(sizeof *m);
     m->rows = rows;
     m->cols = cols;
     return m;
@@ -64,11 +64,11 @@ static void patolette__Matrix2D_init_data(patolette__Matrix2D *m, const double *
 -----------------------------------------------------------------------------*/
     if (data != NULL) {
         size_t bytes = sizeof(double) * m->rows * m->cols;
-        m->data = malloc(bytes);
+        m->data = patolette__ARENA_malloc(bytes);
         memcpy(m->data, data, bytes);
     }
     else {
-        m->data = calloc(
+        m->data = patolette__ARENA_calloc(
             m->rows * m->cols,
             sizeof(double)
         );
@@ -95,8 +95,8 @@ void patolette__Matrix2D_destroy(patolette__Matrix2D *m) {
         return;
     }
 
-    free(m->data);
-    free(m);
+    patolette__ARENA_free(m->data);
+    patolette__ARENA_free(m);
 }
 
 patolette__Matrix2D *patolette__Matrix2D_init(
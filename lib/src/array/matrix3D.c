@@ -23,8 +23,8 @@ void patolette__Matrix3D_destroy(patolette__Matrix3D *m) {
         return;
     }
 
-    free(m->data);
-    free(m);
+    patolette__ARENA_free(m->data);
+    patolette__ARENA_free(m);
 }
 
 patolette__Matrix3D *patolette__Matrix3D_init(size_t xDim, size_t yDim, size_t zDim) {
@@ -41,11 +41,11 @@ patolette__Matrix3D *patolette__Matrix3D_init(size_t xDim, size_t yDim, size_t z
    @note
    x varies the fastest in memory, followed by y and z.
 -----------------------------------------------------------------------------*/
-    patolette__Matrix3D *m = malloc(sizeof(*m));
+    patolette__Matrix3D *m = patolette__ARENA_malloc(sizeof(*m));
     m->xDim = xDim;
     m->yDim = yDim;
     m->zDim = zDim;
-    m->data = calloc(xDim * yDim * zDim, sizeof(double));
+    m->data = patolette__ARENA_calloc(xDim * yDim * zDim, sizeof(double));
     return m;
 }
 
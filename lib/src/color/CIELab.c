@@ -0,0 +1,94 @@
+#include "color/CIELab.h"
+
+/*----------------------------------------------------------------------------
+   Conversions to CIELab color space.
+
+   CIELab: https://en.wikipedia.org/wiki/CIELAB_color_space
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Constants START
+-----------------------------------------------------------------------------*/
+
+// Reference white for the D65 illuminant
+static double rwx = 0.95047;
+static double rwy = 1.0;
+static double rwz = 1.08883;
+
+static double kE = 216.0 / 24389.0;
+static double kK = 24389.0 / 27.0;
+
+/*----------------------------------------------------------------------------
+   Constants END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Declarations START
+-----------------------------------------------------------------------------*/
+
+static double f(double t);
+
+/*----------------------------------------------------------------------------
+   Declarations END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Internal functions START
+-----------------------------------------------------------------------------*/
+
+static double f(double t) {
+/*----------------------------------------------------------------------------
+   The CIELab companding function.
+
+   @params
+   t - A CIE XYZ coordinate, relative to the reference white.
+-----------------------------------------------------------------------------*/
+    return (t > kE) ? cbrt(t) : (kK * t + 16.0) / 116.0;
+}
+
+/*----------------------------------------------------------------------------
+   Internal functions END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Exported functions START
+-----------------------------------------------------------------------------*/
+
+void patolette__COLOR_sRGB_to_CIELab(
+    double r,
+    double g,
+    double b,
+    double *L,
+    double *A,
+    double *B
+) {
+/*----------------------------------------------------------------------------
+   Converts a color from sRGB color space to CIELab color space.
+
+   @params
+   r - R coordinate.
+   g - G coordinate.
+   b - B coordinate.
+   L - output L coordinate.
+   A - output a coordinate.
+   B - output b coordinate.
+-----------------------------------------------------------------------------*/
+    double x, y, z;
+    patolette__COLOR_sRGB_to_XYZ(r, g, b, &x, &y, &z);
+
+    double fx = f(x / rwx);
+    double fy = f(y / rwy);
+    double fz = f(z / rwz);
+
+    *L = 116.0 * fy - 16.0;
+    *A = 500.0 * (fx - fy);
+    *B = 200.0 * (fy - fz);
+}
+
+/*----------------------------------------------------------------------------
+   Exported functions END
+-----------------------------------------------------------------------------*/
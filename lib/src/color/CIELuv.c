@@ -20,7 +20,6 @@ static double rwx = 0.95047;
 static double rwy = 1.0;
 static double rwz = 1.08883;
 
-static double kE = 216.0 / 24389.0;
 static double kK = 24389.0 / 27.0;
 static double kKE = 8.0;
 
@@ -29,70 +28,6 @@ static double kKE = 8.0;
 -----------------------------------------------------------------------------*/
 
 
-/*----------------------------------------------------------------------------
-   Declarations START
------------------------------------------------------------------------------*/
-
-static void XYZ_to_CIELuv(
-    double x,
-    double y,
-    double z,
-    double *L,
-    double *u,
-    double *v
-);
-
-/*----------------------------------------------------------------------------
-   Declarations END
------------------------------------------------------------------------------*/
-
-
-/*----------------------------------------------------------------------------
-   Internal functions START
------------------------------------------------------------------------------*/
-
-static void XYZ_to_CIELuv(
-    double x,
-    double y,
-    double z,
-    double *L,
-    double *u,
-    double *v
-) {
-/*----------------------------------------------------------------------------
-   Converts a color from CIE XYZ space to CIELuv space.
-
-   @params
-   x - X coordinate.
-   y - Y coordinate.
-   z - Z coordinate.
-   L - output L coordinate.
-   u - output u coordinate.
-   v - output v coordinate.
------------------------------------------------------------------------------*/
-    double den = x + 15.0 * y + 3.0 * z;
-    double up = (den > 0.0) ? ((4.0 * x) / (x + 15.0 * y + 3.0 * z)) : 0.0;
-    double vp = (den > 0.0) ? ((9.0 * y) / (x + 15.0 * y + 3.0 * z)) : 0.0;
-
-    double urp = (4.0 * rwx) / (rwx + 15.0 * rwy + 3.0 * rwz);
-    double vrp = (9.0 * rwy) / (rwx + 15.0 * rwy + 3.0 * rwz);
-
-    double yr = y / rwy;
-
-    double L_ = (yr > kE) ? (116.0 * pow(yr, 1.0 / 3.0) - 16.0) : (kK * yr);
-    double u_ = 13.0 * L_ * (up - urp);
-    double v_ = 13.0 * L_ * (vp - vrp);
-
-    *L = L_;
-    *u = u_;
-    *v = v_;
-}
-
-/*----------------------------------------------------------------------------
-   Internal functions END
------------------------------------------------------------------------------*/
-
-
 /*----------------------------------------------------------------------------
    Exported functions START
 -----------------------------------------------------------------------------*/
@@ -171,29 +106,7 @@ void patolette__COLOR_sRGB_Matrix_to_CIELuv_Matrix(patolette__Matrix2D *sRGB) {
    @params
    sRGB - The sRGB color matrix.
 -----------------------------------------------------------------------------*/
-    for (size_t i = 0; i < sRGB->rows; i++) {
-        double r = patolette__Matrix2D_index(sRGB, i, 0);
-        double g = patolette__Matrix2D_index(sRGB, i, 1);
-        double b = patolette__Matrix2D_index(sRGB, i, 2);
-
-        r = patolette__COLOR_sRGB_gamma_decode(r);
-        g = patolette__COLOR_sRGB_gamma_decode(g);
-        b = patolette__COLOR_sRGB_gamma_decode(b);
-
-        double x = r * 0.4124564 + g * 0.3575761 + b * 0.1804375;
-        double y = r * 0.2126729 + g * 0.7151522 + b * 0.0721750;
-        double z = r * 0.0193339 + g * 0.1191920 + b * 0.9503041;
-
-        double L;
-        double u;
-        double v;
-
-        XYZ_to_CIELuv(x, y, z, &L, &u, &v);
-
-        patolette__Matrix2D_index(sRGB, i, 0) = L;
-        patolette__Matrix2D_index(sRGB, i, 1) = u;
-        patolette__Matrix2D_index(sRGB, i, 2) = v;
-    }
+    patolette__COLOR_apply_kernel(sRGB, patolette__COLOR_KERNEL_sRGB_to_CIELuv);
 }
 
 /*----------------------------------------------------------------------------
@@ -7,72 +7,6 @@
 -----------------------------------------------------------------------------*/
 
 
-/*----------------------------------------------------------------------------
-   Declarations START
------------------------------------------------------------------------------*/
-
-static void ICtCp_to_Linear_Rec2020(
-    double I,
-    double Ct,
-    double Cp,
-    double *r2020,
-    double *g2020,
-    double *b2020
-);
-
-/*----------------------------------------------------------------------------
-   Declarations END
------------------------------------------------------------------------------*/
-
-
-/*----------------------------------------------------------------------------
-   Internal functions START
------------------------------------------------------------------------------*/
-
-static void ICtCp_to_Linear_Rec2020(
-    double I,
-    double Ct,
-    double Cp,
-    double *r2020,
-    double *g2020,
-    double *b2020
-) {
-/*----------------------------------------------------------------------------
-   Converts a color from ICtCp space to Linear Rec2020 (RGB) space.
-
-   @params
-   I - I coordinate.
-   Ct - Ct coordinate.
-   Cp - Cp coordinate.
-   r2020 - Output R coordinate.
-   g2020 - Output G coordinate.
-   b2020 - Output B coordinate.
-
-   @note
-   Functions in ICtCp.c output ICtCp triplets with a halved Ct
-   coordinate (check relevant functions descriptions), thus
-   the Ct coordinate is first doubled here.
------------------------------------------------------------------------------*/
-    Ct *= 2;
-
-    double L_ = I + 0.00860904 * Ct + 0.11102963 * Cp;
-    double M_ = I - 0.00860904 * Ct - 0.11102963 * Cp;
-    double S_ = I + 0.56003134 * Ct - 0.32062717 * Cp;
-
-    double L = patolette__COLOR_eotf_ST2084(L_);
-    double M = patolette__COLOR_eotf_ST2084(M_);
-    double S = patolette__COLOR_eotf_ST2084(S_);
-
-    *r2020 = L * 3.43660669 - M * 2.50645212 + S * 0.06984542;
-    *g2020 = -L * 0.79132956 + M * 1.98360045 - S * 0.1922709;
-    *b2020 = -L * 0.0259499 - M * 0.09891371 + S * 1.12486361;
-}
-
-/*----------------------------------------------------------------------------
-   Internal functions END
------------------------------------------------------------------------------*/
-
-
 /*----------------------------------------------------------------------------
    Exported functions START
 -----------------------------------------------------------------------------*/
@@ -133,18 +67,7 @@ void patolette__COLOR_ICtCp_Matrix_to_Linear_Rec2020_Matrix(patolette__Matrix2D
    @params
    ICtCp - The ICtCp color matrix.
 -----------------------------------------------------------------------------*/
-    for (size_t i = 0; i < ICtCp->rows; i++) {
-        double I = patolette__Matrix2D_index(ICtCp, i, 0);
-        double Ct = patolette__Matrix2D_index(ICtCp, i, 1);
-        double Cp = patolette__Matrix2D_index(ICtCp, i, 2);
-
-        double r2020, g2020, b2020;
-        ICtCp_to_Linear_Rec2020(I, Ct, Cp, &r2020, &g2020, &b2020);
-
-        patolette__Matrix2D_index(ICtCp, i, 0) = r2020;
-        patolette__Matrix2D_index(ICtCp, i, 1) = g2020;
-        patolette__Matrix2D_index(ICtCp, i, 2) = b2020;
-    }
+    patolette__COLOR_apply_kernel(ICtCp, patolette__COLOR_KERNEL_ICtCp_to_Linear_Rec2020);
 }
 
 void patolette__COLOR_CIELuv_Matrix_to_Linear_Rec2020_Matrix(patolette__Matrix2D *CIELuv) {
@@ -155,21 +78,7 @@ void patolette__COLOR_CIELuv_Matrix_to_Linear_Rec2020_Matrix(patolette__Matrix2D
    @params
    CIELuv - The CIELuv color matrix.
 -----------------------------------------------------------------------------*/
-    for (size_t i = 0; i < CIELuv->rows; i++) {
-        double L = patolette__Matrix2D_index(CIELuv, i, 0);
-        double u = patolette__Matrix2D_index(CIELuv, i, 1);
-        double v = patolette__Matrix2D_index(CIELuv, i, 2);
-
-        double x, y, z;
-        patolette__COLOR_CIELuv_to_XYZ(L, u, v, &x, &y, &z);
-
-        double r2020, g2020, b2020;
-        patolette__COLOR_XYZ_to_Linear_Rec2020(x, y, z, &r2020, &g2020, &b2020);
-
-        patolette__Matrix2D_index(CIELuv, i, 0) = r2020;
-        patolette__Matrix2D_index(CIELuv, i, 1) = g2020;
-        patolette__Matrix2D_index(CIELuv, i, 2) = b2020;
-    }
+    patolette__COLOR_apply_kernel(CIELuv, patolette__COLOR_KERNEL_CIELuv_to_Linear_Rec2020);
 }
 
 void patolette__COLOR_sRGB_Matrix_to_Linear_Rec2020_Matrix(patolette__Matrix2D *sRGB) {
@@ -180,18 +89,7 @@ void patolette__COLOR_sRGB_Matrix_to_Linear_Rec2020_Matrix(patolette__Matrix2D *
    @params
    sRGB - The sRGB color matrix.
 -----------------------------------------------------------------------------*/
-    for (size_t i = 0; i < sRGB->rows; i++) {
-        double r = patolette__Matrix2D_index(sRGB, i, 0);
-        double g = patolette__Matrix2D_index(sRGB, i, 1);
-        double b = patolette__Matrix2D_index(sRGB, i, 2);
-
-        double r2020, g2020, b2020;
-        patolette__COLOR_sRGB_to_Linear_Rec2020(r, g, b, &r2020, &g2020, &b2020);
-
-        patolette__Matrix2D_index(sRGB, i, 0) = r2020;
-        patolette__Matrix2D_index(sRGB, i, 1) = g2020;
-        patolette__Matrix2D_index(sRGB, i, 2) = b2020;
-    }
+    patolette__COLOR_apply_kernel(sRGB, patolette__COLOR_KERNEL_sRGB_to_Linear_Rec2020);
 }
 
 /*----------------------------------------------------------------------------
@@ -21,7 +21,7 @@
 
     During the dithering process, many nearest neighbour queries must be made
     to find the closest palette color to some unknown color. To do that quickly,
-    a FLANN index is built first with all the palette colors.
+    a nearest neighbour index is built first with all the palette colors.
 
     When inserting a palette color P into the index, it's inserted as:
         P' = P[R] * R_weight + P[G] * G_weight + P[B] * B_weight
@@ -88,11 +88,11 @@ static patolette__Matrix2D *palette;
 // Reference to the palette map
 static size_t *palette_map;
 
-// FLANN index (used for nearest neighbor search)
-static flann_index_t flann_index;
+// Nearest neighbour backend
+static const patolette__NNBackend *nn_backend;
 
-// FLANN params (used for nearest neighbor search)
-static struct FLANNParameters flann_params;
+// Nearest neighbour index of the (weighted) palette
+static void *nn_index;
 
 static int get_level();
 static void move(Direction direction);
@@ -109,7 +109,8 @@ static void init_state(
     size_t input_width,
     size_t input_height,
     patolette__Matrix2D *input_palette,
-    size_t *input_palette_map
+    size_t *input_palette_map,
+    const patolette__NNBackend *backend
 );
 
 /*----------------------------------------------------------------------------
@@ -311,12 +312,11 @@ static void dither_current_pixel() {
     double corrected_G = G + error_G;
     double corrected_B = B + error_B;
 
-    size_t index = patolette__PALETTE_find_closest(
+    size_t index = nn_backend->find_closest(
+        nn_index,
         R_weight * corrected_R,
         G_weight * corrected_G,
-        B_weight * corrected_B,
-        flann_index,
-        &flann_params
+        B_weight * corrected_B
     );
 
     corrected_R = patolette__Matrix2D_index(palette, index, 0);
@@ -347,7 +347,7 @@ static void destroy_state() {
     patolette__Matrix2D_destroy(error_queue);
     patolette__Vector_destroy(weights);
     patolette__Matrix3D_destroy(image);
-    flann_free_index_double(flann_index, &flann_params);
+    nn_backend->destroy_index(nn_index);
 }
 
 static void init_error_queue() {
@@ -399,7 +399,8 @@ static void init_state(
     size_t input_width,
     size_t input_height,
     patolette__Matrix2D *input_palette,
-    size_t *input_palette_map
+    size_t *input_palette_map,
+    const patolette__NNBackend *backend
 ) {
 /*----------------------------------------------------------------------------
     Initializes entire state.
@@ -416,12 +417,12 @@ static void init_state(
     init_weights();
     init_image(colors);
 
-    flann_index = patolette__PALETTE_build_palette_index(
+    nn_backend = backend;
+    nn_index = nn_backend->build_index(
         palette,
         (float)R_weight,
         (float)G_weight,
-        (float)B_weight,
-        &flann_params
+        (float)B_weight
     );
 }
 
@@ -439,14 +440,16 @@ void patolette__DITHER_riemersma(
     size_t input_width, 
     size_t input_height,
     patolette__Matrix2D *input_palette,
-    size_t *input_palette_map
+    size_t *input_palette_map,
+    const patolette__NNBackend *backend
 ) {
     init_state(
         colors,
         input_width,
         input_height,
         input_palette,
-        input_palette_map
+        input_palette_map,
+        backend
     );
 
     int level = get_level();
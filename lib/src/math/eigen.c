@@ -122,7 +122,7 @@ patolette__Vector *patolette__EIGEN_solve(patolette__Matrix2D *m) {
     w = evals->data;
 
     lwork = (int)qwork[0];
-    double *work = malloc(lwork);
+    double *work = patolette__ARENA_malloc(sizeof(double) * lwork);
 
     dsyev(
         &jobz, 
@@ -135,7 +135,7 @@ patolette__Vector *patolette__EIGEN_solve(patolette__Matrix2D *m) {
         &info
     );
 
-    free(work);
+    patolette__ARENA_free(work);
     return evals;
 }
 
@@ -116,7 +116,7 @@ void patolette__PCA_destroy(patolette__PCA *pca) {
     pca - The PCA object.
 -----------------------------------------------------------------------------*/
     patolette__Vector_destroy(pca->axis);
-    free(pca);
+    patolette__ARENA_free(pca);
 }
 
 patolette__PCA *patolette__PCA_perform_PCA_vcov(patolette__Matrix2D *vcov) {
@@ -132,7 +132,7 @@ patolette__PCA *patolette__PCA_perform_PCA_vcov(patolette__Matrix2D *vcov) {
         return NULL;
     }
 
-    patolette__PCA *result = malloc(sizeof *result);
+    patolette__PCA *result = patolette__ARENA_malloc(sizeof *result);
     size_t eval_idx = vcov->cols - 1;
 
     result->axis = patolette__Matrix2D_extract_column(vcov, eval_idx);
@@ -0,0 +1,326 @@
+#include "memory/arena.h"
+
+/*----------------------------------------------------------------------------
+   patolette__ARENA
+
+   This file defines the scoped allocator. Check "memory/arena.h".
+
+   Every allocation is prefixed with a small header that records where it
+   came from, so that patolette__ARENA_free can tell arena allocations
+   (which are never freed individually) from heap allocations (which are).
+
+   Each thread owns an arena (a list of chunks it bumps through), so
+   allocating never takes a lock. Scopes nest per thread: each one records
+   how far its thread's arena was bumped when it began, and rolls the arena
+   back to that point when it ends. Threads that haven't begun a scope
+   (e.g. the workers of a parallel region) allocate from the heap.
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Constants START
+-----------------------------------------------------------------------------*/
+
+// All allocations are aligned to this (as malloc would)
+static const size_t alignment = 16;
+
+// Size of each arena chunk
+static const size_t chunk_size = 1 << 20;
+
+// Allocations larger than this are served from the heap
+static const size_t max_arena_size = 1 << 16;
+
+static const size_t heap_tag = 0x68656170;
+static const size_t arena_tag = 0x6172656e;
+
+/*----------------------------------------------------------------------------
+   Constants END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Declarations START
+-----------------------------------------------------------------------------*/
+
+// Prefix of every allocation
+typedef struct Header {
+    // Either heap_tag or arena_tag
+    size_t tag;
+
+    // The requested size (also keeps the allocation aligned)
+    size_t size;
+} Header;
+
+typedef struct Chunk {
+    // The next (older) chunk
+    struct Chunk *next;
+
+    // Bytes in use
+    size_t used;
+
+    // The chunk's memory
+    unsigned char *data;
+} Chunk;
+
+// Where an arena stood when a scope began. Allocated from the arena
+// itself, right at that point.
+typedef struct Scope {
+    // The chunk being bumped through, or NULL if there was none
+    Chunk *chunk;
+
+    // Bytes of that chunk in use
+    size_t used;
+
+    // The enclosing scope, or NULL
+    struct Scope *outer;
+} Scope;
+
+typedef struct Arena {
+    // The chunk being bumped through, followed by older ones
+    Chunk *chunks;
+
+    // A released chunk kept around for reuse, or NULL
+    Chunk *spare;
+
+    // The innermost scope, or NULL if none has begun
+    Scope *scope;
+} Arena;
+
+static size_t align(size_t size);
+static Arena *get_local_arena(void);
+static void *arena_alloc(Arena *arena, size_t size);
+static void rewind_arena(Arena *arena, Chunk *chunk, size_t used);
+static void *allocate(size_t size, bool zero);
+
+/*----------------------------------------------------------------------------
+   Declarations END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   State START
+-----------------------------------------------------------------------------*/
+
+// The calling thread's arena
+static Arena *local_arena = NULL;
+#pragma omp threadprivate(local_arena)
+
+/*----------------------------------------------------------------------------
+   State END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Internal functions START
+-----------------------------------------------------------------------------*/
+
+static size_t align(size_t size) {
+/*----------------------------------------------------------------------------
+   Rounds a size up to the allocation alignment.
+
+   @params
+   size - The size, in bytes.
+-----------------------------------------------------------------------------*/
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+static Arena *get_local_arena(void) {
+/*----------------------------------------------------------------------------
+   Gets the calling thread's arena, creating it on first use.
+-----------------------------------------------------------------------------*/
+    if (local_arena != NULL) {
+        return local_arena;
+    }
+
+    Arena *arena = malloc(sizeof *arena);
+    arena->chunks = NULL;
+    arena->spare = NULL;
+    arena->scope = NULL;
+
+    local_arena = arena;
+    return arena;
+}
+
+static void *arena_alloc(Arena *arena, size_t size) {
+/*----------------------------------------------------------------------------
+   Bumps an arena.
+
+   @params
+   arena - The arena.
+   size - The size of the allocation, in bytes. Must be aligned, and no
+   larger than chunk_size.
+
+   @note
+   When the current chunk is full, a new one is started and whatever
+   was left of the old one is wasted. Allocations are small relative to
+   chunks, so this is never much.
+-----------------------------------------------------------------------------*/
+    Chunk *chunk = arena->chunks;
+
+    if (chunk == NULL || chunk->used + size > chunk_size) {
+        if (arena->spare != NULL) {
+            chunk = arena->spare;
+            arena->spare = NULL;
+        }
+        else {
+            chunk = malloc(sizeof *chunk);
+            chunk->data = malloc(chunk_size);
+        }
+
+        chunk->used = 0;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+    }
+
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+static void rewind_arena(Arena *arena, Chunk *chunk, size_t used) {
+/*----------------------------------------------------------------------------
+   Rolls an arena back to an earlier point. Chunks started since then
+   are released: one is kept as a spare, the rest are freed.
+
+   @params
+   arena - The arena.
+   chunk - The chunk that was being bumped through, or NULL if there was
+   none.
+   used - Bytes of that chunk that were in use.
+-----------------------------------------------------------------------------*/
+    while (arena->chunks != chunk) {
+        Chunk *newer = arena->chunks;
+        arena->chunks = newer->next;
+
+        if (arena->spare == NULL) {
+            arena->spare = newer;
+        }
+        else {
+            free(newer->data);
+            free(newer);
+        }
+    }
+
+    if (chunk != NULL) {
+        chunk->used = used;
+    }
+}
+
+static void *allocate(size_t size, bool zero) {
+/*----------------------------------------------------------------------------
+   Allocates memory, from the calling thread's arena if it has begun a
+   scope and the allocation is small enough, from the heap otherwise.
+
+   @params
+   size - The size of the allocation, in bytes.
+   zero - Whether memory should be zeroed.
+-----------------------------------------------------------------------------*/
+    size_t header_size = align(sizeof(Header));
+    size_t total_size = header_size + align(size);
+
+    Arena *arena = local_arena;
+
+    Header *header;
+    if (arena != NULL && arena->scope != NULL && total_size <= max_arena_size) {
+        header = arena_alloc(arena, total_size);
+        header->tag = arena_tag;
+        if (zero) {
+            memset((unsigned char*)header + header_size, 0, size);
+        }
+    }
+    else {
+        header = zero ? calloc(1, total_size) : malloc(total_size);
+        header->tag = heap_tag;
+    }
+
+    header->size = size;
+    return (unsigned char*)header + header_size;
+}
+
+/*----------------------------------------------------------------------------
+   Internal functions END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Exported functions START
+-----------------------------------------------------------------------------*/
+
+void patolette__ARENA_begin(void) {
+/*----------------------------------------------------------------------------
+   Begins a scope on the calling thread. Until it ends, the thread's
+   small allocations are served from its arena.
+
+   @note
+   Scopes nest, and only affect the thread that begins them. A run is
+   the outermost scope; inner ones bound the scratch of repeated steps,
+   so it doesn't pile up over the run.
+-----------------------------------------------------------------------------*/
+    Arena *arena = get_local_arena();
+    Chunk *chunk = arena->chunks;
+    size_t used = chunk == NULL ? 0 : chunk->used;
+
+    Scope *scope = arena_alloc(arena, align(sizeof(Scope)));
+    scope->chunk = chunk;
+    scope->used = used;
+    scope->outer = arena->scope;
+    arena->scope = scope;
+}
+
+void patolette__ARENA_end(void) {
+/*----------------------------------------------------------------------------
+   Ends the calling thread's innermost scope, releasing all arena memory
+   it allocated since the scope began.
+
+   @note
+   Everything the thread allocated from its arena during the scope is
+   invalid afterwards.
+-----------------------------------------------------------------------------*/
+    Arena *arena = local_arena;
+    Scope *scope = arena->scope;
+    arena->scope = scope->outer;
+    rewind_arena(arena, scope->chunk, scope->used);
+}
+
+void *patolette__ARENA_malloc(size_t size) {
+/*----------------------------------------------------------------------------
+   Allocates memory.
+
+   @params
+   size - The size of the allocation, in bytes.
+-----------------------------------------------------------------------------*/
+    return allocate(size, false);
+}
+
+void *patolette__ARENA_calloc(size_t count, size_t size) {
+/*----------------------------------------------------------------------------
+   Allocates zeroed memory.
+
+   @params
+   count - The number of items.
+   size - The size of each item, in bytes.
+-----------------------------------------------------------------------------*/
+    return allocate(count * size, true);
+}
+
+void patolette__ARENA_free(void *ptr) {
+/*----------------------------------------------------------------------------
+   Frees memory. Arena allocations are released when their scope ends,
+   so for them this is a no-op.
+
+   @params
+   ptr - The allocation.
+-----------------------------------------------------------------------------*/
+    if (ptr == NULL) {
+        return;
+    }
+
+    Header *header = (Header*)((unsigned char*)ptr - align(sizeof(Header)));
+    if (header->tag == heap_tag) {
+        free(header);
+    }
+}
+
+/*----------------------------------------------------------------------------
+   Exported functions END
+-----------------------------------------------------------------------------*/
@@ -0,0 +1,1007 @@
+#include "palette/kmeans.h"
+
+/*----------------------------------------------------------------------------
+    A native KMeans engine for weighted 3D points (colors).
+
+    It runs Lloyd iteration, using Hamerly's bounds to skip most distance
+    computations: each point keeps an upper bound on the distance to its
+    center and a lower bound on the distance to any other center. After
+    the first few iterations, centers barely move, so the bounds stay
+    tight and most points are proven to keep their center without
+    looking at any other one.
+
+    Points that do need a search only look at the centers in an annulus
+    around the origin: since the two nearest centers are within some
+    distance r of the point, their norms are within r of the point's.
+    Centers are sorted by norm each iteration, so the annulus is a
+    contiguous range of them.
+
+    G. Hamerly, "Making k-means even faster", SDM 2010.
+    J. Drake, G. Hamerly, "Accelerated k-means with adaptive distance
+    bounds", NIPS OPT 2012.
+
+    A mini-batch engine is also provided, for palettes and inputs so large
+    that even bounded full-batch iterations are expensive. Centers are
+    moved towards points drawn at random in small batches, with per-center
+    learning rates.
+
+    D. Sculley, "Web-scale k-means clustering", WWW 2010.
+
+    @note
+    Data is laid out as FAISS lays it out (row-major floats), so either
+    engine can be run on the same buffers.
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+    Constants START
+-----------------------------------------------------------------------------*/
+
+// Relative slack for annulus bounds, to absorb rounding errors
+static const double annulus_slack = 1e-9;
+
+// Seed for mini-batch draws
+static const uint64_t batch_seed = 1234;
+
+/*----------------------------------------------------------------------------
+    Constants END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+    Declarations START
+-----------------------------------------------------------------------------*/
+
+typedef struct RankedCenter {
+    double norm;
+    size_t index;
+} RankedCenter;
+
+typedef struct SortedCenters {
+    // Center coordinates, sorted by norm
+    double *x;
+    double *y;
+    double *z;
+
+    // Center norms, sorted
+    double *norm;
+
+    // The (unsorted) index of each sorted center
+    size_t *index;
+
+    // Scratch space for sorting
+    RankedCenter *ranked;
+} SortedCenters;
+
+static uint64_t hash(uint64_t x);
+static int compare_ranked_centers(const void *a, const void *b);
+
+static void SortedCenters_init(SortedCenters *sorted, size_t center_count);
+static void SortedCenters_destroy(SortedCenters *sorted);
+
+static void sort_centers(
+    const double *cx,
+    const double *cy,
+    const double *cz,
+    size_t center_count,
+    SortedCenters *sorted
+);
+
+static void find_annulus(
+    const SortedCenters *sorted,
+    size_t center_count,
+    double norm,
+    double radius,
+    size_t *begin,
+    size_t *end
+);
+
+static double get_distance(
+    const float *x,
+    const double *cx,
+    const double *cy,
+    const double *cz,
+    size_t center
+);
+
+static size_t get_nearest(
+    const float *x,
+    const SortedCenters *sorted,
+    size_t begin,
+    size_t end,
+    double *scratch,
+    double *nearest,
+    double *second,
+    size_t *second_index
+);
+
+static size_t search_nearest(
+    const float *x,
+    const SortedCenters *sorted,
+    size_t center_count
+);
+
+static double update_centers(
+    const float *samples,
+    const float *weights,
+    const size_t *assignment,
+    size_t center_count,
+    size_t sample_count,
+    double *cx,
+    double *cy,
+    double *cz,
+    double *moved
+);
+
+static void update_separation(
+    const double *cx,
+    const double *cy,
+    const double *cz,
+    size_t center_count,
+    double *separation
+);
+
+/*----------------------------------------------------------------------------
+    Declarations END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+    Internal functions START
+-----------------------------------------------------------------------------*/
+
+static double get_distance(
+    const float *x,
+    const double *cx,
+    const double *cy,
+    const double *cz,
+    size_t center
+) {
+/*----------------------------------------------------------------------------
+    Gets the distance between a point and a center.
+
+    @params
+    x - The point.
+    cx, cy, cz - The center coordinates.
+    center - The center index.
+-----------------------------------------------------------------------------*/
+    double dx = x[0] - cx[center];
+    double dy = x[1] - cy[center];
+    double dz = x[2] - cz[center];
+    return sqrt(SQ(dx) + SQ(dy) + SQ(dz));
+}
+
+static uint64_t hash(uint64_t x) {
+/*----------------------------------------------------------------------------
+    Hashes an integer (splitmix64 finalizer).
+
+    @params
+    x - The integer.
+-----------------------------------------------------------------------------*/
+    x += 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
+
+static void SortedCenters_init(SortedCenters *sorted, size_t center_count) {
+/*----------------------------------------------------------------------------
+    Allocates space for a set of sorted centers.
+
+    @params
+    sorted - The sorted centers.
+    center_count - Number of centers.
+-----------------------------------------------------------------------------*/
+    sorted->x = patolette__ARENA_malloc(sizeof(double) * center_count);
+    sorted->y = patolette__ARENA_malloc(sizeof(double) * center_count);
+    sorted->z = patolette__ARENA_malloc(sizeof(double) * center_count);
+    sorted->norm = patolette__ARENA_malloc(sizeof(double) * center_count);
+    sorted->index = patolette__ARENA_malloc(sizeof(size_t) * center_count);
+    sorted->ranked = patolette__ARENA_malloc(sizeof(RankedCenter) * center_count);
+}
+
+static void SortedCenters_destroy(SortedCenters *sorted) {
+/*----------------------------------------------------------------------------
+    Frees the space held by a set of sorted centers.
+
+    @params
+    sorted - The sorted centers.
+-----------------------------------------------------------------------------*/
+    patolette__ARENA_free(sorted->x);
+    patolette__ARENA_free(sorted->y);
+    patolette__ARENA_free(sorted->z);
+    patolette__ARENA_free(sorted->norm);
+    patolette__ARENA_free(sorted->index);
+    patolette__ARENA_free(sorted->ranked);
+}
+
+static int compare_ranked_centers(const void *a, const void *b) {
+/*----------------------------------------------------------------------------
+    qsort comparator that ranks centers by increasing norm. Ties are
+    broken by index, so the order is deterministic.
+
+    @param
+    a - The first RankedCenter.
+    b - The second RankedCenter.
+-----------------------------------------------------------------------------*/
+    const RankedCenter *ra = a;
+    const RankedCenter *rb = b;
+
+    if (ra->norm != rb->norm) {
+        return ra->norm < rb->norm ? -1 : 1;
+    }
+
+    return ra->index < rb->index ? -1 : 1;
+}
+
+static void sort_centers(
+    const double *cx,
+    const double *cy,
+    const double *cz,
+    size_t center_count,
+    SortedCenters *sorted
+) {
+/*----------------------------------------------------------------------------
+    Sorts centers by norm.
+
+    @params
+    cx, cy, cz - The center coordinates.
+    center_count - Number of centers.
+    sorted - On exit, the sorted centers.
+-----------------------------------------------------------------------------*/
+    for (size_t j = 0; j < center_count; j++) {
+        sorted->ranked[j].norm = sqrt(SQ(cx[j]) + SQ(cy[j]) + SQ(cz[j]));
+        sorted->ranked[j].index = j;
+    }
+
+    qsort(sorted->ranked, center_count, sizeof *sorted->ranked, compare_ranked_centers);
+
+    for (size_t j = 0; j < center_count; j++) {
+        size_t index = sorted->ranked[j].index;
+        sorted->x[j] = cx[index];
+        sorted->y[j] = cy[index];
+        sorted->z[j] = cz[index];
+        sorted->norm[j] = sorted->ranked[j].norm;
+        sorted->index[j] = index;
+    }
+}
+
+static void find_annulus(
+    const SortedCenters *sorted,
+    size_t center_count,
+    double norm,
+    double radius,
+    size_t *begin,
+    size_t *end
+) {
+/*----------------------------------------------------------------------------
+    Finds the (sorted) range of centers whose norm is within some
+    distance of a given norm.
+
+    @params
+    sorted - The sorted centers.
+    center_count - Number of centers.
+    norm - The norm.
+    radius - The distance.
+    begin - On exit, the first center in range.
+    end - On exit, one past the last center in range.
+-----------------------------------------------------------------------------*/
+    radius += annulus_slack * (1 + radius + norm);
+    double low = norm - radius;
+    double high = norm + radius;
+
+    size_t lo = 0;
+    size_t hi = center_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (sorted->norm[mid] < low) {
+            lo = mid + 1;
+        }
+
+        else {
+            hi = mid;
+        }
+    }
+    *begin = lo;
+
+    hi = center_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (sorted->norm[mid] <= high) {
+            lo = mid + 1;
+        }
+
+        else {
+            hi = mid;
+        }
+    }
+    *end = lo;
+}
+
+static size_t get_nearest(
+    const float *x,
+    const SortedCenters *sorted,
+    size_t begin,
+    size_t end,
+    double *scratch,
+    double *nearest,
+    double *second,
+    size_t *second_index
+) {
+/*----------------------------------------------------------------------------
+    Finds the nearest center to a point among a (sorted) range of
+    centers, as well as the second nearest one.
+
+    Squared distances to all centers in range are computed first, in a
+    loop over (struct of arrays) center coordinates that vectorizes, and
+    only then scanned.
+
+    @params
+    x - The point.
+    sorted - The sorted centers.
+    begin - The first center in range.
+    end - One past the last center in range.
+    scratch - Space for (end - begin) distances.
+    nearest - On exit, the distance to the nearest center.
+    second - On exit, the distance to the second nearest center
+    (INFINITY if there's a single center in range).
+    second_index - On exit, the second nearest center (unchanged if
+    there's a single center in range).
+-----------------------------------------------------------------------------*/
+    double px = x[0];
+    double py = x[1];
+    double pz = x[2];
+
+    const double *sx = sorted->x;
+    const double *sy = sorted->y;
+    const double *sz = sorted->z;
+
+    #pragma omp simd
+    for (size_t j = begin; j < end; j++) {
+        double dx = px - sx[j];
+        double dy = py - sy[j];
+        double dz = pz - sz[j];
+        scratch[j - begin] = dx * dx + dy * dy + dz * dz;
+    }
+
+    size_t best = begin;
+    size_t runner_up = end;
+    double d1 = INFINITY;
+    double d2 = INFINITY;
+    for (size_t j = begin; j < end; j++) {
+        double d = scratch[j - begin];
+        if (d < d1) {
+            d2 = d1;
+            runner_up = best;
+            d1 = d;
+            best = j;
+        }
+
+        else if (d < d2) {
+            d2 = d;
+            runner_up = j;
+        }
+    }
+
+    *nearest = sqrt(d1);
+    *second = sqrt(d2);
+    if (d2 < INFINITY) {
+        *second_index = sorted->index[runner_up];
+    }
+
+    return sorted->index[best];
+}
+
+static size_t search_nearest(
+    const float *x,
+    const SortedCenters *sorted,
+    size_t center_count
+) {
+/*----------------------------------------------------------------------------
+    Finds the nearest center to a point.
+
+    The search starts at the centers whose norm is closest to the
+    point's, and moves outwards in both directions, until the norm
+    difference alone exceeds the best distance found.
+
+    @params
+    x - The point.
+    sorted - The sorted centers.
+    center_count - Number of centers.
+-----------------------------------------------------------------------------*/
+    double px = x[0];
+    double py = x[1];
+    double pz = x[2];
+    double norm = sqrt(SQ(px) + SQ(py) + SQ(pz));
+
+    size_t begin;
+    size_t end;
+    find_annulus(sorted, center_count, norm, 0, &begin, &end);
+
+    // Candidates are [0, low) going down, [high, center_count) going up
+    size_t low = begin;
+    size_t high = begin;
+
+    size_t best = 0;
+    double best_distance = INFINITY;
+    while (low > 0 || high < center_count) {
+        double gap_low = low > 0 ? norm - sorted->norm[low - 1] : INFINITY;
+        double gap_high = high < center_count ? sorted->norm[high] - norm : INFINITY;
+
+        size_t j;
+        double gap;
+        if (gap_low <= gap_high) {
+            j = --low;
+            gap = gap_low;
+        }
+
+        else {
+            j = high++;
+            gap = gap_high;
+        }
+
+        if (gap > 0 && SQ(gap) >= best_distance) {
+            break;
+        }
+
+        double d = SQ(px - sorted->x[j]) + SQ(py - sorted->y[j]) + SQ(pz - sorted->z[j]);
+        if (d < best_distance) {
+            best_distance = d;
+            best = j;
+        }
+    }
+
+    return sorted->index[best];
+}
+
+static double update_centers(
+    const float *samples,
+    const float *weights,
+    const size_t *assignment,
+    size_t center_count,
+    size_t sample_count,
+    double *cx,
+    double *cy,
+    double *cz,
+    double *moved
+) {
+/*----------------------------------------------------------------------------
+    Moves each center to the (weighted) mean of the points assigned to
+    it. Centers with no (weight) assigned stay in place.
+
+    Sums are accumulated into per-thread partials, then reduced.
+
+    Returns the objective (the weighted sum of squared distances from
+    each point to its center) before the centers are moved. It comes
+    from the same sums, as sum(w|x|^2) - 2c.sum(wx) + |c|^2 sum(w).
+
+    @params
+    samples - List of points.
+    weights - Weight of each point, or NULL.
+    assignment - The center each point is assigned to.
+    center_count - Number of centers.
+    sample_count - Number of points.
+    cx, cy, cz - The center coordinates.
+    moved - On exit, how far each center moved.
+-----------------------------------------------------------------------------*/
+    int thread_count = omp_get_max_threads();
+    double *partials = patolette__ARENA_calloc(
+        (size_t)thread_count * center_count * 5,
+        sizeof(double)
+    );
+    double objective = 0;
+
+    #pragma omp parallel reduction(+:objective)
+    {
+        double *partial = partials + (size_t)omp_get_thread_num() * center_count * 5;
+
+        #pragma omp for schedule(static)
+        for (size_t i = 0; i < sample_count; i++) {
+            double w = weights == NULL ? 1 : weights[i];
+            double x = samples[i * 3];
+            double y = samples[i * 3 + 1];
+            double z = samples[i * 3 + 2];
+            double *sums = partial + assignment[i] * 5;
+            sums[0] += x * w;
+            sums[1] += y * w;
+            sums[2] += z * w;
+            sums[3] += w;
+            sums[4] += (SQ(x) + SQ(y) + SQ(z)) * w;
+        }
+
+        #pragma omp for schedule(static)
+        for (size_t j = 0; j < center_count; j++) {
+            double sx = 0;
+            double sy = 0;
+            double sz = 0;
+            double sw = 0;
+            double sq = 0;
+            for (int t = 0; t < thread_count; t++) {
+                double *sums = partials + ((size_t)t * center_count + j) * 5;
+                sx += sums[0];
+                sy += sums[1];
+                sz += sums[2];
+                sw += sums[3];
+                sq += sums[4];
+            }
+
+            double dot = cx[j] * sx + cy[j] * sy + cz[j] * sz;
+            double norm = SQ(cx[j]) + SQ(cy[j]) + SQ(cz[j]);
+            objective += sq - 2 * dot + norm * sw;
+
+            moved[j] = 0;
+            if (sw <= 0) {
+                continue;
+            }
+
+            double x = sx / sw;
+            double y = sy / sw;
+            double z = sz / sw;
+            moved[j] = sqrt(SQ(x - cx[j]) + SQ(y - cy[j]) + SQ(z - cz[j]));
+            cx[j] = x;
+            cy[j] = y;
+            cz[j] = z;
+        }
+    }
+
+    patolette__ARENA_free(partials);
+    return objective;
+}
+
+static void update_separation(
+    const double *cx,
+    const double *cy,
+    const double *cz,
+    size_t center_count,
+    double *separation
+) {
+/*----------------------------------------------------------------------------
+    Computes half the distance from each center to its nearest center.
+    A point closer than that to its own center can't be closer to any
+    other one.
+
+    @params
+    cx, cy, cz - The center coordinates.
+    center_count - Number of centers.
+    separation - On exit, each center's half distance to its nearest
+    center (INFINITY if there's a single center).
+-----------------------------------------------------------------------------*/
+    #pragma omp parallel for schedule(static)
+    for (size_t j = 0; j < center_count; j++) {
+        double x = cx[j];
+        double y = cy[j];
+        double z = cz[j];
+
+        double m = INFINITY;
+        #pragma omp simd reduction(min:m)
+        for (size_t k = 0; k < center_count; k++) {
+            double d = SQ(x - cx[k]) + SQ(y - cy[k]) + SQ(z - cz[k]);
+            d = k == j ? INFINITY : d;
+            m = d < m ? d : m;
+        }
+
+        separation[j] = 0.5 * sqrt(m);
+    }
+}
+
+/*----------------------------------------------------------------------------
+    Internal functions END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+    Exported functions START
+-----------------------------------------------------------------------------*/
+
+void patolette__KMEANS_hamerly(
+    float *centers,
+    const float *samples,
+    const float *weights,
+    size_t center_count,
+    size_t sample_count,
+    int niter,
+    double tolerance,
+    bool verbose,
+    int *iterations,
+    double *objective
+) {
+/*----------------------------------------------------------------------------
+    Runs (weighted) KMeans on a set of 3D points, starting from the
+    supplied centers.
+
+    @params
+    centers - List of initial centers. On exit, the final centers.
+    samples - List of points.
+    weights - Weight of each point, or NULL.
+    center_count - Number of centers (cluster count).
+    sample_count - Number of points.
+    niter - Maximum number of iterations. Iteration stops earlier if
+    no point changes center.
+    tolerance - Iteration also stops once the relative objective
+    improvement, or the largest center shift, of an iteration is at
+    most this. Anything <= 0 disables it.
+    iterations - On exit, the number of iterations run.
+    objective - On exit, the objective of the last iteration (the
+    weighted sum of squared distances from each point to its center).
+
+    @note
+    Both centers and samples are row-major, i.e [x0, y0, z0, x1, ...].
+-----------------------------------------------------------------------------*/
+    *iterations = 0;
+    *objective = 0;
+
+    if (center_count == 0 || sample_count == 0 || niter <= 0) {
+        return;
+    }
+
+    double *cx = patolette__ARENA_malloc(sizeof(double) * center_count);
+    double *cy = patolette__ARENA_malloc(sizeof(double) * center_count);
+    double *cz = patolette__ARENA_malloc(sizeof(double) * center_count);
+    double *moved = patolette__ARENA_malloc(sizeof(double) * center_count);
+    double *separation = patolette__ARENA_malloc(sizeof(double) * center_count);
+
+    SortedCenters sorted;
+    SortedCenters_init(&sorted, center_count);
+
+    // Each point's center, the runner up and the bounds
+    size_t *assignment = patolette__ARENA_malloc(sizeof(size_t) * sample_count);
+    size_t *runner_up = patolette__ARENA_calloc(sample_count, sizeof(size_t));
+    double *upper = patolette__ARENA_malloc(sizeof(double) * sample_count);
+    double *lower = patolette__ARENA_malloc(sizeof(double) * sample_count);
+
+    // Scratch space for get_nearest, one slice per thread
+    double *scratch = patolette__ARENA_malloc(
+        sizeof(double) * center_count * (size_t)omp_get_max_threads()
+    );
+
+    for (size_t j = 0; j < center_count; j++) {
+        cx[j] = centers[j * 3];
+        cy[j] = centers[j * 3 + 1];
+        cz[j] = centers[j * 3 + 2];
+    }
+
+    sort_centers(cx, cy, cz, center_count, &sorted);
+
+    // Initial assignment, the only exhaustive one
+    #pragma omp parallel
+    {
+        double *local_scratch = &scratch[center_count * (size_t)omp_get_thread_num()];
+
+        #pragma omp for schedule(static)
+        for (size_t i = 0; i < sample_count; i++) {
+            assignment[i] = get_nearest(
+                samples + i * 3,
+                &sorted,
+                0,
+                center_count,
+                local_scratch,
+                &upper[i],
+                &lower[i],
+                &runner_up[i]
+            );
+        }
+    }
+
+    double previous = 0;
+    for (int iter = 0; iter < niter; iter++) {
+        *objective = update_centers(
+            samples,
+            weights,
+            assignment,
+            center_count,
+            sample_count,
+            cx,
+            cy,
+            cz,
+            moved
+        );
+        *iterations = iter + 1;
+
+        if (iter == niter - 1) {
+            break;
+        }
+
+        // The two largest center movements
+        size_t r = 0;
+        double p1 = 0;
+        double p2 = 0;
+        for (size_t j = 0; j < center_count; j++) {
+            if (moved[j] > p1) {
+                p2 = p1;
+                p1 = moved[j];
+                r = j;
+            }
+
+            else if (moved[j] > p2) {
+                p2 = moved[j];
+            }
+        }
+
+        if (tolerance > 0) {
+            bool converged = p1 <= tolerance || (
+                iter > 0 &&
+                previous - *objective <= tolerance * previous
+            );
+
+            if (converged) {
+                break;
+            }
+        }
+        previous = *objective;
+
+        sort_centers(cx, cy, cz, center_count, &sorted);
+        update_separation(cx, cy, cz, center_count, separation);
+
+        size_t changed = 0;
+        size_t scanned = 0;
+        size_t evaluated = 0;
+
+        #pragma omp parallel reduction(+:changed, scanned, evaluated)
+        {
+            double *local_scratch = &scratch[center_count * (size_t)omp_get_thread_num()];
+
+            #pragma omp for schedule(static)
+            for (size_t i = 0; i < sample_count; i++) {
+                const float *x = samples + i * 3;
+                size_t a = assignment[i];
+
+                // Centers moved, loosen the bounds accordingly
+                upper[i] += moved[a];
+                lower[i] -= a == r ? p2 : p1;
+
+                double bound = max(separation[a], lower[i]);
+                if (upper[i] <= bound) {
+                    continue;
+                }
+
+                // Tighten the upper bound, and try again
+                upper[i] = get_distance(x, cx, cy, cz, a);
+                if (upper[i] <= bound) {
+                    continue;
+                }
+
+                // Both nearest centers are within radius of the point,
+                // search the annulus their norms must lie in
+                double radius = max(upper[i], get_distance(x, cx, cy, cz, runner_up[i]));
+                double norm = sqrt(SQ((double)x[0]) + SQ((double)x[1]) + SQ((double)x[2]));
+
+                size_t begin;
+                size_t end;
+                find_annulus(&sorted, center_count, norm, radius, &begin, &end);
+
+                size_t b = get_nearest(
+                    x,
+                    &sorted,
+                    begin,
+                    end,
+                    local_scratch,
+                    &upper[i],
+                    &lower[i],
+                    &runner_up[i]
+                );
+
+                scanned++;
+                evaluated += end - begin;
+                if (b != a) {
+                    assignment[i] = b;
+                    changed++;
+                }
+            }
+        }
+
+        if (verbose) {
+            printf(
+                "patolette ======== KMeans iteration %d: %zu of %zu points searched (%.1f centers each), %zu reassigned\n",
+                iter + 1,
+                scanned,
+                sample_count,
+                scanned > 0 ? (double)evaluated / scanned : 0,
+                changed
+            );
+        }
+
+        // Converged, centers would not move anymore
+        if (changed == 0) {
+            break;
+        }
+    }
+
+    for (size_t j = 0; j < center_count; j++) {
+        centers[j * 3] = (float)cx[j];
+        centers[j * 3 + 1] = (float)cy[j];
+        centers[j * 3 + 2] = (float)cz[j];
+    }
+
+    patolette__ARENA_free(cx);
+    patolette__ARENA_free(cy);
+    patolette__ARENA_free(cz);
+    patolette__ARENA_free(moved);
+    patolette__ARENA_free(separation);
+    SortedCenters_destroy(&sorted);
+    patolette__ARENA_free(assignment);
+    patolette__ARENA_free(runner_up);
+    patolette__ARENA_free(upper);
+    patolette__ARENA_free(lower);
+    patolette__ARENA_free(scratch);
+}
+
+void patolette__KMEANS_minibatch(
+    float *centers,
+    const float *samples,
+    const float *weights,
+    size_t center_count,
+    size_t sample_count,
+    size_t batch_size,
+    int niter,
+    double tolerance,
+    bool verbose,
+    int *iterations,
+    double *objective
+) {
+/*----------------------------------------------------------------------------
+    Runs (weighted) mini-batch KMeans on a set of 3D points, starting
+    from the supplied centers, and polishes the result with one full
+    (Lloyd) iteration.
+
+    Each iteration draws a batch of points at random, assigns them to
+    their nearest centers, and moves each center towards its points with
+    a learning rate of w / W, w being the point's weight and W the total
+    weight assigned to the center so far. Since centers are warm-started,
+    W is seeded by assigning one batch without moving any center, so
+    that centers are not overwritten by their first points.
+
+    @params
+    centers - List of initial centers. On exit, the final centers.
+    samples - List of points.
+    weights - Weight of each point, or NULL.
+    center_count - Number of centers (cluster count).
+    sample_count - Number of points.
+    batch_size - Number of points in each batch.
+    niter - Number of batches (iteration budget).
+    tolerance - Iteration stops early once the largest center shift of
+    an iteration is at most this. Anything <= 0 disables it.
+    iterations - On exit, the number of iterations run, including
+    the final full one.
+    objective - On exit, the objective of the final full iteration.
+
+    @note
+    Both centers and samples are row-major, i.e [x0, y0, z0, x1, ...].
+-----------------------------------------------------------------------------*/
+    *iterations = 0;
+    *objective = 0;
+
+    if (center_count == 0 || sample_count == 0 || niter <= 0) {
+        return;
+    }
+
+    if (batch_size == 0) {
+        batch_size = 1;
+    }
+
+    double *cx = patolette__ARENA_malloc(sizeof(double) * center_count);
+    double *cy = patolette__ARENA_malloc(sizeof(double) * center_count);
+    double *cz = patolette__ARENA_malloc(sizeof(double) * center_count);
+    double *total = patolette__ARENA_calloc(center_count, sizeof(double));
+    double *moved = patolette__ARENA_malloc(sizeof(double) * center_count);
+
+    SortedCenters sorted;
+    SortedCenters_init(&sorted, center_count);
+
+    size_t *batch = patolette__ARENA_malloc(sizeof(size_t) * batch_size);
+    size_t *assignment = patolette__ARENA_malloc(sizeof(size_t) * batch_size);
+
+    for (size_t j = 0; j < center_count; j++) {
+        cx[j] = centers[j * 3];
+        cy[j] = centers[j * 3 + 1];
+        cz[j] = centers[j * 3 + 2];
+    }
+
+    uint64_t draw = 0;
+    for (int iter = -1; iter < niter; iter++) {
+        for (size_t b = 0; b < batch_size; b++) {
+            batch[b] = hash(batch_seed ^ draw++) % sample_count;
+        }
+
+        // Assign with fixed centers
+        sort_centers(cx, cy, cz, center_count, &sorted);
+
+        #pragma omp parallel for schedule(static)
+        for (size_t b = 0; b < batch_size; b++) {
+            assignment[b] = search_nearest(
+                samples + batch[b] * 3,
+                &sorted,
+                center_count
+            );
+        }
+
+        // Seed batch, only accumulate weight
+        if (iter < 0) {
+            for (size_t b = 0; b < batch_size; b++) {
+                double w = weights == NULL ? 1 : weights[batch[b]];
+                total[assignment[b]] += w;
+            }
+
+            continue;
+        }
+
+        for (size_t j = 0; j < center_count; j++) {
+            moved[j] = 0;
+        }
+
+        for (size_t b = 0; b < batch_size; b++) {
+            size_t j = assignment[b];
+            const float *x = samples + batch[b] * 3;
+
+            double w = weights == NULL ? 1 : weights[batch[b]];
+            if (w <= 0) {
+                continue;
+            }
+
+            total[j] += w;
+            double eta = w / total[j];
+
+            double dx = eta * (x[0] - cx[j]);
+            double dy = eta * (x[1] - cy[j]);
+            double dz = eta * (x[2] - cz[j]);
+            cx[j] += dx;
+            cy[j] += dy;
+            cz[j] += dz;
+            moved[j] += sqrt(SQ(dx) + SQ(dy) + SQ(dz));
+        }
+
+        *iterations = iter + 1;
+
+        double shift = 0;
+        for (size_t j = 0; j < center_count; j++) {
+            shift = max(shift, moved[j]);
+        }
+
+        if (verbose) {
+            printf(
+                "patolette ======== KMeans batch %d: largest center shift %g\n",
+                iter + 1,
+                shift
+            );
+        }
+
+        if (tolerance > 0 && shift <= tolerance) {
+            break;
+        }
+    }
+
+    for (size_t j = 0; j < center_count; j++) {
+        centers[j * 3] = (float)cx[j];
+        centers[j * 3 + 1] = (float)cy[j];
+        centers[j * 3 + 2] = (float)cz[j];
+    }
+
+    patolette__ARENA_free(cx);
+    patolette__ARENA_free(cy);
+    patolette__ARENA_free(cz);
+    patolette__ARENA_free(total);
+    patolette__ARENA_free(moved);
+    SortedCenters_destroy(&sorted);
+    patolette__ARENA_free(batch);
+    patolette__ARENA_free(assignment);
+
+    // Polish, one full assignment and update
+    int polish_iterations;
+    patolette__KMEANS_hamerly(
+        centers,
+        samples,
+        weights,
+        center_count,
+        sample_count,
+        1,
+        0,
+        false,
+        &polish_iterations,
+        objective
+    );
+
+    *iterations += polish_iterations;
+}
+
+/*----------------------------------------------------------------------------
+    Exported functions END
+-----------------------------------------------------------------------------*/
@@ -1,11 +1,15 @@
 #include "palette/nearest.h"
 
 /*----------------------------------------------------------------------------
-    This file defines functions to perform nearest neighbour queries via the
-    FLANN library, all in the context of trying to find the closest color P
-    in a color palette to some other color C.
-
-    FLANN: https://github.com/flann-lib/flann
+    This file defines the nearest neighbour backends, all in the context of
+    trying to find the closest color P in a color palette to some other
+    color C.
+
+    - FLANN: https://github.com/flann-lib/flann (KD-tree).
+    - Native: an exact search over palette colors sorted by norm. It starts
+      at the colors whose norm is closest to C's, and moves outwards until
+      the norm difference alone exceeds the best distance found. It has no
+      dependencies, so it's always available.
 -----------------------------------------------------------------------------*/
 
 
@@ -13,6 +17,51 @@
     Declarations START
 -----------------------------------------------------------------------------*/
 
+typedef struct RankedColor {
+    double norm;
+    size_t index;
+} RankedColor;
+
+typedef struct NativeIndex {
+    size_t count;
+
+    // Palette coordinates (scaled), sorted by norm
+    double *x;
+    double *y;
+    double *z;
+
+    // Palette color norms, sorted
+    double *norm;
+
+    // The palette index of each sorted color
+    size_t *index;
+} NativeIndex;
+
+static int compare_ranked_colors(const void *a, const void *b);
+
+static void *native_build_index(
+    const patolette__Matrix2D *palette,
+    double fx,
+    double fy,
+    double fz
+);
+static size_t native_find_closest(void *index, double x, double y, double z);
+static void native_find_closest_batch(
+    void *index,
+    const patolette__Matrix2D *colors,
+    size_t *palette_map
+);
+static void native_destroy_index(void *index);
+
+#ifdef PATOLETTE_WITH_FLANN
+typedef struct FlannIndex {
+    flann_index_t index;
+    struct FLANNParameters params;
+
+    // The (scaled) palette data, which FLANN doesn't copy
+    double *data;
+} FlannIndex;
+
 static double *build_index_data(
     const patolette__Matrix2D *colors,
     double fx,
@@ -20,15 +69,232 @@ static double *build_index_data(
     double fz
 );
 
+static void *flann_build_index(
+    const patolette__Matrix2D *palette,
+    double fx,
+    double fy,
+    double fz
+);
+static size_t flann_find_closest(void *index, double x, double y, double z);
+static void flann_find_closest_batch(
+    void *index,
+    const patolette__Matrix2D *colors,
+    size_t *palette_map
+);
+static void flann_destroy_index(void *index);
+#endif
+
 /*----------------------------------------------------------------------------
     Declarations END
 -----------------------------------------------------------------------------*/
 
 
+/*----------------------------------------------------------------------------
+    Backends START
+-----------------------------------------------------------------------------*/
+
+static const patolette__NNBackend native_backend = {
+    "Native",
+    native_build_index,
+    native_find_closest,
+    native_find_closest_batch,
+    native_destroy_index
+};
+
+#ifdef PATOLETTE_WITH_FLANN
+static const patolette__NNBackend flann_backend = {
+    "FLANN",
+    flann_build_index,
+    flann_find_closest,
+    flann_find_closest_batch,
+    flann_destroy_index
+};
+#endif
+
+/*----------------------------------------------------------------------------
+    Backends END
+-----------------------------------------------------------------------------*/
+
+
 /*----------------------------------------------------------------------------
     Internal functions START
 -----------------------------------------------------------------------------*/
 
+static int compare_ranked_colors(const void *a, const void *b) {
+/*----------------------------------------------------------------------------
+    qsort comparator that ranks colors by increasing norm. Ties are
+    broken by index, so the order is deterministic.
+
+    @param
+    a - The first RankedColor.
+    b - The second RankedColor.
+-----------------------------------------------------------------------------*/
+    const RankedColor *ra = a;
+    const RankedColor *rb = b;
+
+    if (ra->norm != rb->norm) {
+        return ra->norm < rb->norm ? -1 : 1;
+    }
+
+    return ra->index < rb->index ? -1 : 1;
+}
+
+static void *native_build_index(
+    const patolette__Matrix2D *palette,
+    double fx,
+    double fy,
+    double fz
+) {
+/*----------------------------------------------------------------------------
+    Builds a native index from a color palette.
+
+    @params
+    palette - The color palette.
+    fx - A scale factor for the x coordinate of each color.
+    fy - A scale factor for the y coordinate of each color.
+    fz - A scale factor for the z coordinate of each color.
+-----------------------------------------------------------------------------*/
+    size_t count = palette->rows;
+
+    NativeIndex *index = patolette__ARENA_malloc(sizeof(NativeIndex));
+    index->count = count;
+    index->x = patolette__ARENA_malloc(sizeof(double) * count);
+    index->y = patolette__ARENA_malloc(sizeof(double) * count);
+    index->z = patolette__ARENA_malloc(sizeof(double) * count);
+    index->norm = patolette__ARENA_malloc(sizeof(double) * count);
+    index->index = patolette__ARENA_malloc(sizeof(size_t) * count);
+
+    RankedColor *ranked = patolette__ARENA_malloc(sizeof(RankedColor) * count);
+    for (size_t i = 0; i < count; i++) {
+        double cx = patolette__Matrix2D_index(palette, i, 0) * fx;
+        double cy = patolette__Matrix2D_index(palette, i, 1) * fy;
+        double cz = patolette__Matrix2D_index(palette, i, 2) * fz;
+        ranked[i].norm = sqrt(SQ(cx) + SQ(cy) + SQ(cz));
+        ranked[i].index = i;
+    }
+
+    qsort(ranked, count, sizeof *ranked, compare_ranked_colors);
+
+    for (size_t j = 0; j < count; j++) {
+        size_t i = ranked[j].index;
+        index->x[j] = patolette__Matrix2D_index(palette, i, 0) * fx;
+        index->y[j] = patolette__Matrix2D_index(palette, i, 1) * fy;
+        index->z[j] = patolette__Matrix2D_index(palette, i, 2) * fz;
+        index->norm[j] = ranked[j].norm;
+        index->index[j] = i;
+    }
+
+    patolette__ARENA_free(ranked);
+    return index;
+}
+
+static size_t native_find_closest(void *index, double x, double y, double z) {
+/*----------------------------------------------------------------------------
+    Finds the index of the closest color in a color palette to a supplied
+    color, via a native index.
+
+    @params
+    index - The native index.
+    x - The x coordinate of the color.
+    y - The y coordinate of the color.
+    z - The z coordinate of the color.
+-----------------------------------------------------------------------------*/
+    const NativeIndex *native = index;
+    size_t count = native->count;
+    double norm = sqrt(SQ(x) + SQ(y) + SQ(z));
+
+    // First color with a norm >= the query's
+    size_t lo = 0;
+    size_t hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (native->norm[mid] < norm) {
+            lo = mid + 1;
+        }
+
+        else {
+            hi = mid;
+        }
+    }
+
+    // Candidates are [0, low) going down, [high, count) going up
+    size_t low = lo;
+    size_t high = lo;
+
+    size_t best = 0;
+    double best_distance = INFINITY;
+    while (low > 0 || high < count) {
+        double gap_low = low > 0 ? norm - native->norm[low - 1] : INFINITY;
+        double gap_high = high < count ? native->norm[high] - norm : INFINITY;
+
+        size_t j;
+        double gap;
+        if (gap_low <= gap_high) {
+            j = --low;
+            gap = gap_low;
+        }
+
+        else {
+            j = high++;
+            gap = gap_high;
+        }
+
+        if (SQ(gap) > best_distance) {
+            break;
+        }
+
+        double d = SQ(x - native->x[j]) + SQ(y - native->y[j]) + SQ(z - native->z[j]);
+        if (d < best_distance) {
+            best_distance = d;
+            best = j;
+        }
+    }
+
+    return native->index[best];
+}
+
+static void native_find_closest_batch(
+    void *index,
+    const patolette__Matrix2D *colors,
+    size_t *palette_map
+) {
+/*----------------------------------------------------------------------------
+    Maps each color in a list to its closest palette color, via a native
+    index.
+
+    @params
+    index - The native index.
+    colors - The list of colors.
+    palette_map - The map to be filled.
+-----------------------------------------------------------------------------*/
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < colors->rows; i++) {
+        palette_map[i] = native_find_closest(
+            index,
+            patolette__Matrix2D_index(colors, i, 0),
+            patolette__Matrix2D_index(colors, i, 1),
+            patolette__Matrix2D_index(colors, i, 2)
+        );
+    }
+}
+
+static void native_destroy_index(void *index) {
+/*----------------------------------------------------------------------------
+    Destroys a native index.
+
+    @params
+    index - The native index.
+-----------------------------------------------------------------------------*/
+    NativeIndex *native = index;
+    patolette__ARENA_free(native->x);
+    patolette__ARENA_free(native->y);
+    patolette__ARENA_free(native->z);
+    patolette__ARENA_free(native->norm);
+    patolette__ARENA_free(native->index);
+    patolette__ARENA_free(native);
+}
+
+#ifdef PATOLETTE_WITH_FLANN
 static double *build_index_data(
     const patolette__Matrix2D *colors,
     double fx,
@@ -40,14 +306,14 @@ static double *build_index_data(
 
     @params
     colors - The list of colors.
-    fx - A scale factor for the z coordinate of each color.
+    fx - A scale factor for the x coordinate of each color.
     fy - A scale factor for the y coordinate of each color.
     fz - A scale factor for the z coordinate of each color.
 
     @note
     Check dithering module for the reason behind the scale factors.
 -----------------------------------------------------------------------------*/
-    double *data = malloc(sizeof(double) * colors->rows * colors->cols);
+    double *data = patolette__ARENA_malloc(sizeof(double) * colors->rows * colors->cols);
     for (size_t i = 0; i < colors->rows; i++) {
         double cx = patolette__Matrix2D_index(colors, i, 0);
         double cy = patolette__Matrix2D_index(colors, i, 1);
@@ -60,21 +326,11 @@ static double *build_index_data(
     return data;
 }
 
-/*----------------------------------------------------------------------------
-    Internal functions END
------------------------------------------------------------------------------*/
-
-
-/*----------------------------------------------------------------------------
-    Exported functions START
------------------------------------------------------------------------------*/
-
-flann_index_t patolette__PALETTE_build_palette_index(
+static void *flann_build_index(
     const patolette__Matrix2D *palette,
     double fx,
     double fy,
-    double fz,
-    struct FLANNParameters *params
+    double fz
 ) {
 /*----------------------------------------------------------------------------
     Builds a FLANN index from a color palette that can be later used
@@ -82,10 +338,9 @@ flann_index_t patolette__PALETTE_build_palette_index(
 
     @params
     palette - The color palette.
-    fx - A scale factor for the z coordinate of each color.
+    fx - A scale factor for the x coordinate of each color.
     fy - A scale factor for the y coordinate of each color.
     fz - A scale factor for the z coordinate of each color.
-    params - FLANNParameters object.
 
     @note
     Check dithering module for the reason behind the scale factors.
@@ -93,71 +348,70 @@ flann_index_t patolette__PALETTE_build_palette_index(
     size_t cols = 3;
     size_t rows = palette->rows;
 
-    double *data = build_index_data(palette, fx, fy, fz);
+    FlannIndex *index = patolette__ARENA_malloc(sizeof(FlannIndex));
+    index->data = build_index_data(palette, fx, fy, fz);
 
-    *params = DEFAULT_FLANN_PARAMETERS;
-    params->algorithm = FLANN_INDEX_KDTREE_SINGLE;
-    params->cores = 1;
-    params->eps = 0;
+    index->params = DEFAULT_FLANN_PARAMETERS;
+    // Single KD-Tree is the fastest for our use case
+    index->params.algorithm = FLANN_INDEX_KDTREE_SINGLE;
+    index->params.cores = 1;
+    // Exact nearest neighbour match
+    index->params.eps = 0;
 
     float speedup;
-    flann_index_t flann_index = flann_build_index_double(
-        data,
+    index->index = flann_build_index_double(
+        index->data,
         (int)rows,
         (int)cols,
         &speedup,
-        params
+        &index->params
     );
 
-    return flann_index;
+    return index;
 }
 
-size_t patolette__PALETTE_find_closest(
-    double x,
-    double y,
-    double z,
-    flann_index_t index,
-    struct FLANNParameters *params
-) {
+static size_t flann_find_closest(void *index, double x, double y, double z) {
 /*----------------------------------------------------------------------------
     Finds the index of the closest color in a color palette to a supplied
-    color.
+    color, via a FLANN index.
 
     @params
+    index - The FLANN index.
     x - The x coordinate of the color.
     y - The y coordinate of the color.
     z - The z coordinate of the color.
-    index - The color palette FLANN index.
-    params - FLANNParameters object.
 -----------------------------------------------------------------------------*/
+    FlannIndex *flann = index;
+
     int i;
     double dist;
     double data[3] = { x, y, z };
 
     flann_find_nearest_neighbors_index_double(
-        index,
+        flann->index,
         &data[0],
         1,
         &i,
         &dist,
         1,
-        params
+        &flann->params
     );
 
     return (size_t)i;
 }
 
-void patolette__PALETTE_fill_palette_map_nearest(
+static void flann_find_closest_batch(
+    void *index,
     const patolette__Matrix2D *colors,
-    const patolette__Matrix2D *palette,
     size_t *palette_map
 ) {
 /*----------------------------------------------------------------------------
-    Maps each color in a list to its closest palette color.
+    Maps each color in a list to its closest palette color, via a FLANN
+    index.
 
     @params
+    index - The FLANN index.
     colors - The list of colors.
-    palette - The color palette.
     palette_map - The map to be filled.
 
     @note
@@ -169,27 +423,20 @@ void patolette__PALETTE_fill_palette_map_nearest(
     in chunks, or with a loop based approach (similar to how it's done for
     dithering).
 -----------------------------------------------------------------------------*/
-    size_t palette_rows = palette->rows;
+    FlannIndex *flann = index;
     size_t colors_rows = colors->rows;
 
-    double *palette_data = build_index_data(palette, 1, 1, 1);
     double *colors_data = build_index_data(colors, 1, 1, 1);
 
-    int *indices = malloc(sizeof(int) * colors_rows);
-    double *distances = malloc(sizeof(double) * colors_rows);
+    int *indices = patolette__ARENA_malloc(sizeof(int) * colors_rows);
+    double *distances = patolette__ARENA_malloc(sizeof(double) * colors_rows);
 
-    struct FLANNParameters params = DEFAULT_FLANN_PARAMETERS;
-    // Single KD-Tree is the fastest for our use case
-    params.algorithm = FLANN_INDEX_KDTREE_SINGLE;
-    // Use as many cores as available (although not sure if applies for KDTREE_SINGLE)
+    struct FLANNParameters params = flann->params;
+    // Use as many cores as available
     params.cores = 0;
-    // Exact nearest neighbour match
-    params.eps = 0;
 
-    flann_find_nearest_neighbors_double(
-        palette_data,
-        (int)palette_rows,
-        3,
+    flann_find_nearest_neighbors_index_double(
+        flann->index,
         colors_data,
         (int)colors_rows,
         indices,
@@ -198,14 +445,79 @@ void patolette__PALETTE_fill_palette_map_nearest(
         &params
     );
 
-    for (size_t i = 0; i < colors->rows; i++) {
+    for (size_t i = 0; i < colors_rows; i++) {
         palette_map[i] = (size_t)(indices[i]);
     }
 
-    free(palette_data);
-    free(colors_data);
-    free(indices);
-    free(distances);
+    patolette__ARENA_free(colors_data);
+    patolette__ARENA_free(indices);
+    patolette__ARENA_free(distances);
+}
+
+static void flann_destroy_index(void *index) {
+/*----------------------------------------------------------------------------
+    Destroys a FLANN index.
+
+    @params
+    index - The FLANN index.
+-----------------------------------------------------------------------------*/
+    FlannIndex *flann = index;
+    flann_free_index_double(flann->index, &flann->params);
+    patolette__ARENA_free(flann->data);
+    patolette__ARENA_free(flann);
+}
+#endif
+
+/*----------------------------------------------------------------------------
+    Internal functions END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+    Exported functions START
+-----------------------------------------------------------------------------*/
+
+const patolette__NNBackend *patolette__PALETTE_get_nn_backend(patolette__NNEngine engine) {
+/*----------------------------------------------------------------------------
+    Gets a nearest neighbour backend.
+
+    @params
+    engine - The nearest neighbour engine.
+
+    @note
+    Returns NULL if the engine is unknown, or wasn't built.
+-----------------------------------------------------------------------------*/
+    if (engine == patolette__NNNative) {
+        return &native_backend;
+    }
+
+#ifdef PATOLETTE_WITH_FLANN
+    if (engine == patolette__NNFLANN) {
+        return &flann_backend;
+    }
+#endif
+
+    return NULL;
+}
+
+void patolette__PALETTE_fill_palette_map_nearest(
+    const patolette__Matrix2D *colors,
+    const patolette__Matrix2D *palette,
+    const patolette__NNBackend *backend,
+    size_t *palette_map
+) {
+/*----------------------------------------------------------------------------
+    Maps each color in a list to its closest palette color.
+
+    @params
+    colors - The list of colors.
+    palette - The color palette.
+    backend - The nearest neighbour backend.
+    palette_map - The map to be filled.
+-----------------------------------------------------------------------------*/
+    void *index = backend->build_index(palette, 1, 1, 1);
+    backend->find_closest_batch(index, colors, palette_map);
+    backend->destroy_index(index);
 }
 
 /*----------------------------------------------------------------------------
@@ -4,7 +4,8 @@
     This file defines functions to perform color palette refinement via
     KMeans iteration.
 
-    KMeans is run via FAISS.
+    KMeans is run via one of several backends: FAISS, or the native engines
+    in kmeans.c.
     FAISS: https://github.com/facebookresearch/faiss
 
     @note
@@ -20,6 +21,9 @@
 
 size_t min_kmeans_samples = SQ(256);
 
+// Seed for sample selection
+static const uint64_t sample_seed = 1234;
+
 /*----------------------------------------------------------------------------
     Constants END
 -----------------------------------------------------------------------------*/
@@ -29,20 +33,51 @@ size_t min_kmeans_samples = SQ(256);
     Declarations START
 -----------------------------------------------------------------------------*/
 
-static void kmeans(
+#ifdef PATOLETTE_WITH_FAISS
+static void faiss_refine(
     float *centers,
-    float *samples,
-    float *weights,
+    const float *samples,
+    const float *weights,
     size_t center_count,
     size_t sample_count,
-    int niter,
-    size_t max_samples,
-    bool verbose
+    const patolette__KMeansParameters *params,
+    int *iterations,
+    double *objective
 );
+#endif
 
-static float *get_centers(const patolette__ColorClusterArray *clusters);
-static float *get_samples(const patolette__Matrix2D *colors);
-static float *get_weights(const patolette__Vector *weights);
+static void hamerly_refine(
+    float *centers,
+    const float *samples,
+    const float *weights,
+    size_t center_count,
+    size_t sample_count,
+    const patolette__KMeansParameters *params,
+    int *iterations,
+    double *objective
+);
+
+static void minibatch_refine(
+    float *centers,
+    const float *samples,
+    const float *weights,
+    size_t center_count,
+    size_t sample_count,
+    const patolette__KMeansParameters *params,
+    int *iterations,
+    double *objective
+);
+
+static uint64_t hash(uint64_t x);
+static size_t get_sample_limit(size_t center_count, size_t max_samples);
+static float *get_centers(const patolette__Matrix2D *palette);
+static float *get_samples(
+    const patolette__Matrix2D *colors,
+    const patolette__Weights *weights,
+    size_t max_count,
+    size_t *sample_count,
+    float **sample_weights
+);
 
 /*----------------------------------------------------------------------------
     Declarations END
@@ -50,43 +85,79 @@ static float *get_weights(const patolette__Vector *weights);
 
 
 /*----------------------------------------------------------------------------
-    Exported functions START
+    Backends START
+-----------------------------------------------------------------------------*/
+
+#ifdef PATOLETTE_WITH_FAISS
+static const patolette__RefineBackend faiss_backend = {
+    "FAISS",
+    faiss_refine
+};
+#endif
+
+static const patolette__RefineBackend hamerly_backend = {
+    "Hamerly",
+    hamerly_refine
+};
+
+static const patolette__RefineBackend minibatch_backend = {
+    "MiniBatch",
+    minibatch_refine
+};
+
+/*----------------------------------------------------------------------------
+    Backends END
 -----------------------------------------------------------------------------*/
 
-static void kmeans(
+
+/*----------------------------------------------------------------------------
+    Internal functions START
+-----------------------------------------------------------------------------*/
+
+#ifdef PATOLETTE_WITH_FAISS
+static void faiss_refine(
     float *centers,
-    float *samples,
-    float *weights,
+    const float *samples,
+    const float *weights,
     size_t center_count,
     size_t sample_count,
-    int niter,
-    size_t max_samples,
-    bool verbose
+    const patolette__KMeansParameters *params,
+    int *iterations,
+    double *objective
 ) {
 /*----------------------------------------------------------------------------
-    Runs KMeans.
+    Runs KMeans via FAISS.
 
     @params
     centers - List of initial centers.
     samples - List of samples.
+    weights - Weight of each sample, or NULL.
     center_count - Number of centers (cluster count).
     sample_count - Number of samples.
-    niter - Number of iterations.
-    max_samples - Maximum number of samples to use.
+    params - KMeans parameters. The tolerance applies to the relative
+    objective improvement, or the largest center shift.
+    iterations - On exit, the number of iterations run.
+    objective - On exit, the objective of the last iteration.
 -----------------------------------------------------------------------------*/
-    FaissClusteringParameters params;
-    faiss_ClusteringParameters_init(&params);
-    params.niter = niter;
-    params.nredo = 1;
-    params.verbose = verbose;
-    params.spherical = false;
-    params.int_centroids = false;
-    params.update_index = false;
-    params.frozen_centroids = false;
-    params.min_points_per_centroid = 1;
-    params.max_points_per_centroid = (int)(max(max_samples, min_kmeans_samples) / center_count);
-    params.seed = 1234;
-    params.decode_block_size = 32768;
+    FaissClusteringParameters faiss_params;
+    faiss_ClusteringParameters_init(&faiss_params);
+    faiss_params.niter = params->niter;
+    faiss_params.nredo = 1;
+    faiss_params.verbose = params->verbose;
+    faiss_params.spherical = false;
+    faiss_params.int_centroids = false;
+    faiss_params.update_index = false;
+    faiss_params.frozen_centroids = false;
+    faiss_params.min_points_per_centroid = 1;
+    faiss_params.max_points_per_centroid = (int)(
+        max(params->max_samples, min_kmeans_samples) / center_count
+    );
+    faiss_params.seed = 1234;
+    faiss_params.decode_block_size = 32768;
+    faiss_params.tolerance = (float)max(params->tolerance, 0);
+
+    float q_error = 0;
+    *iterations = 0;
 
     faiss_kmeans_clustering(
         3,
@@ -94,27 +165,84 @@ static void kmeans(
         center_count,
         samples,
         centers,
+        (float *)weights,
+        &faiss_params,
+        &q_error,
+        iterations
+    );
+
+    *objective = q_error;
+}
+#endif
+
+static void hamerly_refine(
+    float *centers,
+    const float *samples,
+    const float *weights,
+    size_t center_count,
+    size_t sample_count,
+    const patolette__KMeansParameters *params,
+    int *iterations,
+    double *objective
+) {
+/*----------------------------------------------------------------------------
+    Runs KMeans via the native Hamerly engine. Check kmeans.c.
+-----------------------------------------------------------------------------*/
+    patolette__KMEANS_hamerly(
+        centers,
+        samples,
+        weights,
+        center_count,
+        sample_count,
+        params->niter,
+        params->tolerance,
+        params->verbose,
+        iterations,
+        objective
+    );
+}
+
+static void minibatch_refine(
+    float *centers,
+    const float *samples,
+    const float *weights,
+    size_t center_count,
+    size_t sample_count,
+    const patolette__KMeansParameters *params,
+    int *iterations,
+    double *objective
+) {
+/*----------------------------------------------------------------------------
+    Runs KMeans via the native mini-batch engine. Check kmeans.c.
+-----------------------------------------------------------------------------*/
+    patolette__KMEANS_minibatch(
+        centers,
+        samples,
         weights,
-        &params
+        center_count,
+        sample_count,
+        params->batch_size,
+        params->niter,
+        params->tolerance,
+        params->verbose,
+        iterations,
+        objective
     );
 }
 
-static float *get_centers(const patolette__ColorClusterArray *clusters) {
+static float *get_centers(const patolette__Matrix2D *palette) {
 /*----------------------------------------------------------------------------
     Gets initial centers data for FAISS.
 
     @params
-    clusters - List of initial clusters.
+    palette - The initial color palette.
 -----------------------------------------------------------------------------*/
-    float *centers = malloc(sizeof(float) * clusters->length * 3);
+    float *centers = patolette__ARENA_malloc(sizeof(float) * palette->rows * 3);
 
-    for (size_t i = 0; i < clusters->length; i++) {
-        patolette__ColorCluster *cluster = patolette__ColorClusterArray_index(clusters, i);
-        const patolette__Vector *center = patolette__ColorCluster_get_center(cluster);
-
-        double cx = patolette__Vector_index(center, 0);
-        double cy = patolette__Vector_index(center, 1);
-        double cz = patolette__Vector_index(center, 2);
+    for (size_t i = 0; i < palette->rows; i++) {
+        double cx = patolette__Matrix2D_index(palette, i, 0);
+        double cy = patolette__Matrix2D_index(palette, i, 1);
+        double cz = patolette__Matrix2D_index(palette, i, 2);
 
         centers[i * 3] = (float)cx;
         centers[i * 3 + 1] = (float)cy;
@@ -124,102 +252,243 @@ static float *get_centers(const patolette__ColorClusterArray *clusters) {
     return centers;
 }
 
-static float *get_samples(const patolette__Matrix2D *colors) {
+static uint64_t hash(uint64_t x) {
+/*----------------------------------------------------------------------------
+    Hashes an integer (splitmix64 finalizer).
+
+    @params
+    x - The integer.
+-----------------------------------------------------------------------------*/
+    x += 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
+
+static size_t get_sample_limit(size_t center_count, size_t max_samples) {
+/*----------------------------------------------------------------------------
+    Gets the maximum number of samples KMeans is run on. This is the
+    same bound FAISS would subsample to, given the parameters set in
+    kmeans.
+
+    @params
+    center_count - Number of centers (cluster count).
+    max_samples - Maximum number of samples to use.
+-----------------------------------------------------------------------------*/
+    size_t per_center = max(max_samples, min_kmeans_samples) / center_count;
+    return center_count * per_center;
+}
+
+static float *get_samples(
+    const patolette__Matrix2D *colors,
+    const patolette__Weights *weights,
+    size_t max_count,
+    size_t *sample_count,
+    float **sample_weights
+) {
 /*----------------------------------------------------------------------------
     Gets samples data for FAISS.
 
+    If there are more than max_count colors, a stratified sample is drawn
+    straight from them: colors are divided into max_count contiguous
+    strata of (about) the same size, and one color is picked from each
+    one. Since strata are the same size, samples keep their own weight.
+
+    This spares both a full float copy of the colors and FAISS's own
+    subsampling (a random permutation of all of them).
+
     @params
     colors - List of color samples.
+    weights - Weight of each color, or NULL.
+    max_count - Maximum number of samples to draw.
+    sample_count - On exit, the number of samples drawn.
+    sample_weights - On exit, the weight of each sample (NULL if
+    weights is NULL).
 -----------------------------------------------------------------------------*/
-    float *samples = malloc(sizeof(float) * colors->rows * 3);
+    size_t n = colors->rows;
+    size_t count = n > max_count ? max_count : n;
+
+    float *samples = patolette__ARENA_malloc(sizeof(float) * count * 3);
+    float *fweights = NULL;
+    if (weights != NULL) {
+        fweights = patolette__ARENA_malloc(sizeof(float) * count);
+    }
 
-    for (size_t i = 0; i < colors->rows; i++) {
-        double cx = patolette__Matrix2D_index(colors, i, 0);
-        double cy = patolette__Matrix2D_index(colors, i, 1);
-        double cz = patolette__Matrix2D_index(colors, i, 2);
-        samples[i * 3] = (float)cx;
-        samples[i * 3 + 1] = (float)cy;
-        samples[i * 3 + 2] = (float)cz;
+    for (size_t i = 0; i < count; i++) {
+        size_t j = i;
+        if (count < n) {
+            size_t begin = (size_t)((double)i * n / count);
+            size_t end = (size_t)((double)(i + 1) * n / count);
+            if (end > n) {
+                end = n;
+            }
+            if (end <= begin) {
+                end = begin + 1;
+            }
+            j = begin + hash(sample_seed ^ i) % (end - begin);
+        }
+
+        samples[i * 3] = (float)patolette__Matrix2D_index(colors, j, 0);
+        samples[i * 3 + 1] = (float)patolette__Matrix2D_index(colors, j, 1);
+        samples[i * 3 + 2] = (float)patolette__Matrix2D_index(colors, j, 2);
+
+        if (fweights != NULL) {
+            fweights[i] = (float)patolette__Weights_get(weights, j);
+        }
     }
 
+    *sample_count = count;
+    *sample_weights = fweights;
     return samples;
 }
 
-static float *get_weights(const patolette__Vector *weights) {
 /*----------------------------------------------------------------------------
-    Gets weights data for FAISS.
+    Internal functions END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+    Exported functions START
+-----------------------------------------------------------------------------*/
+
+const patolette__RefineBackend *patolette__PALETTE_get_refine_backend(
+    patolette__KMeansEngine engine
+) {
+/*----------------------------------------------------------------------------
+    Gets a KMeans (refinement) backend.
 
     @params
-    colors - List of color weights.
+    engine - The KMeans engine.
+
+    @note
+    Returns NULL if the engine is unknown, or wasn't built.
 -----------------------------------------------------------------------------*/
-    float *fweights = malloc(sizeof(float) * weights->length);
+    if (engine == patolette__KMeansHamerly) {
+        return &hamerly_backend;
+    }
 
-    for (size_t i = 0; i < weights->length; i++) {
-        double w = patolette__Vector_index(weights, i);
-        fweights[i] = (float)w;
+    if (engine == patolette__KMeansMiniBatch) {
+        return &minibatch_backend;
     }
 
-    return fweights;
+#ifdef PATOLETTE_WITH_FAISS
+    if (engine == patolette__KMeansFAISS) {
+        return &faiss_backend;
+    }
+#endif
+
+    return NULL;
 }
 
-patolette__Matrix2D *patolette__PALETTE_get_refined_palette(
+patolette__Matrix2D *patolette__PALETTE_refine(
     const patolette__Matrix2D *colors,
-    const patolette__Vector *weights,
-    const patolette__ColorClusterArray *clusters,
-    int niter,
-    size_t max_samples,
-    bool verbose
+    const patolette__Weights *weights,
+    const patolette__Matrix2D *initial,
+    const patolette__RefineBackend *backend,
+    const patolette__KMeansParameters *params
 ) {
 /*----------------------------------------------------------------------------
-    Refines a color palette via KMeans iteration.
+    Refines a color palette via KMeans iteration, starting from the
+    supplied centers.
 
     @params
     colors - List of colors to quantize.
-    clusters - List of clusters resulting from an earlier quantization.
-    niter - Number of KMeans iterations.
-    max_samples - Maximum number of samples to use.
+    weights - Weight of each color, or NULL.
+    initial - The initial color palette (centers).
+    backend - The KMeans backend.
+    params - KMeans parameters. The tolerance stops iteration early once
+    the relative objective improvement, or the largest center shift, of
+    an iteration is at most this (backends may only check the latter).
 -----------------------------------------------------------------------------*/
+    size_t center_count = initial->rows;
 
-    float *samples = get_samples(colors);
-    float *centers = get_centers(clusters);
+    size_t sample_count;
+    float *fweights;
+    float *samples = get_samples(
+        colors,
+        weights,
+        get_sample_limit(center_count, params->max_samples),
+        &sample_count,
+        &fweights
+    );
+    float *centers = get_centers(initial);
 
-    float *fweights = NULL;
-    if (weights != NULL) {
-        fweights = get_weights(weights);
-    }
+    int iterations;
+    double objective;
 
-    kmeans(
+    backend->refine(
         centers,
         samples,
         fweights,
-        clusters->length,
-        colors->rows,
-        niter,
-        max_samples,
-        verbose
+        center_count,
+        sample_count,
+        params,
+        &iterations,
+        &objective
     );
 
+    if (params->verbose) {
+        printf(
+            "patolette ======== KMeans (%s) ran %d iterations, objective: %g\n",
+            backend->name,
+            iterations,
+            objective
+        );
+    }
+
     patolette__Matrix2D *palette = patolette__Matrix2D_init(
-        clusters->length,
+        center_count,
         3,
         NULL
     );
 
-    for (size_t i = 0; i < clusters->length; i++) {
+    for (size_t i = 0; i < center_count; i++) {
         patolette__Matrix2D_index(palette, i, 0) = (double)centers[i * 3];
         patolette__Matrix2D_index(palette, i, 1) = (double)centers[i * 3 + 1];
         patolette__Matrix2D_index(palette, i, 2) = (double)centers[i * 3 + 2];
     }
 
-    free(centers);
-    free(samples);
+    patolette__ARENA_free(centers);
+    patolette__ARENA_free(samples);
     if (fweights != NULL) {
-        free(fweights);
+        patolette__ARENA_free(fweights);
     }
 
     return palette;
 }
 
+patolette__Matrix2D *patolette__PALETTE_get_refined_palette(
+    const patolette__Matrix2D *colors,
+    const patolette__Weights *weights,
+    const patolette__ClusterTable *table,
+    const patolette__RefineBackend *backend,
+    const patolette__KMeansParameters *params
+) {
+/*----------------------------------------------------------------------------
+    Refines a color palette via KMeans iteration, starting from the
+    centers of a set of clusters.
+
+    @params
+    colors - List of colors to quantize.
+    weights - Weight of each color, or NULL.
+    table - Table of clusters resulting from an earlier quantization.
+    backend - The KMeans backend.
+    params - KMeans parameters, check patolette__PALETTE_refine.
+-----------------------------------------------------------------------------*/
+    patolette__Matrix2D *initial = patolette__PALETTE_create(table);
+
+    patolette__Matrix2D *palette = patolette__PALETTE_refine(
+        colors,
+        weights,
+        initial,
+        backend,
+        params
+    );
+
+    patolette__Matrix2D_destroy(initial);
+    return palette;
+}
+
 /*----------------------------------------------------------------------------
     Exported functions END
 -----------------------------------------------------------------------------*/
\ No newline at end of file
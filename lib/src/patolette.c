@@ -8,10 +8,18 @@
 #include "dither/riemersma.h"
 
 #include "palette/create.h"
+#include "palette/nearest.h"
 #include "palette/refine.h"
 
 #include "quantize/local.h"
 #include "quantize/global.h"
+#include "quantize/histogram.h"
+#include "quantize/pyramid.h"
+#include "quantize/sample.h"
+#include "quantize/weights.h"
+
+#include "saliency/density.h"
+#include "saliency/saliency.h"
 
 /*----------------------------------------------------------------------------
     patolette
@@ -28,13 +36,17 @@ static const int bad_quant = -1;
 static const int bad_dims = -2;
 static const int bad_palette_size = -3;
 static const int huge_dims = -4;
+static const int bad_engine = -5;
+static const int bad_weights = -6;
 
-static const char *exit_code_info_messages[6] = {
+static const char *exit_code_info_messages[7] = {
     "Quantization successful.\0",
     "Internal quantization error.\0",
     "Image dimensions should be greater than 0.\0",
     "Palette size should be greater than 0.\0",
     "Image dimensions are too big.\0",
+    "The requested engine is not available in this build.\0",
+    "The weight map is malformed.\0",
 };
 
 /*----------------------------------------------------------------------------
@@ -49,11 +61,50 @@ static const char *exit_code_info_messages[6] = {
 static void validate_arguments(
     size_t width,
     size_t height,
+    const patolette__WeightMap *weight_map,
     size_t palette_size,
     const patolette__QuantizationOptions *options,
     int *exit_code
 );
 
+static void convert_from_sRGB(
+    patolette__Matrix2D *colors,
+    patolette__ColorSpace color_space
+);
+
+static void convert_to_sRGB(
+    patolette__Matrix2D *colors,
+    patolette__ColorSpace color_space
+);
+
+static void fill_hierarchy(
+    const patolette__ClusterTable *table,
+    size_t base_count,
+    size_t palette_size,
+    patolette__ColorSpace color_space,
+    bool palette_only,
+    patolette__PaletteHierarchy *hierarchy
+);
+
+static const patolette__WeightMap *get_dense_map(
+    const double *weight_data,
+    patolette__WeightMap *map
+);
+
+static void quantize(
+    size_t width,
+    size_t height,
+    const double *color_data,
+    const patolette__WeightMap *weight_map,
+    size_t palette_size,
+    const patolette__QuantizationOptions *options,
+    double *palette,
+    size_t *palette_map,
+    size_t *result_size,
+    patolette__PaletteHierarchy *hierarchy,
+    int *exit_code
+);
+
 /*----------------------------------------------------------------------------
     Internal functions START
 -----------------------------------------------------------------------------*/
@@ -61,6 +112,7 @@ static void validate_arguments(
 static void validate_arguments(
     size_t width,
     size_t height,
+    const patolette__WeightMap *weight_map,
     size_t palette_size,
     const patolette__QuantizationOptions *options,
     int *exit_code
@@ -71,6 +123,7 @@ static void validate_arguments(
     @params
     width - The width of the image.
     height - The height of the image.
+    weight_map - The weight map, or NULL.
     palette_size - The desired palette size.
     options - Quantization options.
     exit_code - On exit, zero if successful, non-zero otherwise.
@@ -91,9 +144,118 @@ static void validate_arguments(
 
     if (width * height > 40000 * 40000) {
         *exit_code = huge_dims;
+        return;
+    }
+
+    if (weight_map != NULL && !patolette__Weights_is_valid_map(weight_map)) {
+        *exit_code = bad_weights;
+        return;
+    }
+
+    bool needs_refine = options->kmeans_niter > 0;
+    if (needs_refine && patolette__PALETTE_get_refine_backend(options->kmeans_engine) == NULL) {
+        *exit_code = bad_engine;
+        return;
+    }
+
+    bool needs_nn = !options->palette_only;
+    if (needs_nn && patolette__PALETTE_get_nn_backend(options->nn_engine) == NULL) {
+        *exit_code = bad_engine;
     }
 }
 
+static void convert_from_sRGB(
+    patolette__Matrix2D *colors,
+    patolette__ColorSpace color_space
+) {
+/*----------------------------------------------------------------------------
+    Converts colors from sRGB[0, 1] to the color space used for palette
+    generation (in place).
+
+    @params
+    colors - The colors.
+    color_space - The color space.
+-----------------------------------------------------------------------------*/
+    if (color_space == patolette__CIELuv) {
+        patolette__COLOR_sRGB_Matrix_to_CIELuv_Matrix(colors);
+    }
+
+    else if (color_space == patolette__ICtCp) {
+        patolette__COLOR_sRGB_Matrix_to_ICtCp_Matrix(colors);
+    }
+}
+
+static void convert_to_sRGB(
+    patolette__Matrix2D *colors,
+    patolette__ColorSpace color_space
+) {
+/*----------------------------------------------------------------------------
+    Converts colors from the color space used for palette generation
+    to sRGB[0, 1] (in place).
+
+    @params
+    colors - The colors.
+    color_space - The color space.
+-----------------------------------------------------------------------------*/
+    if (color_space == patolette__CIELuv) {
+        patolette__COLOR_CIELuv_Matrix_to_Linear_Rec2020_Matrix(colors);
+        patolette__COLOR_Linear_Rec2020_Matrix_to_sRGB_Matrix(colors);
+    }
+
+    else if (color_space == patolette__ICtCp) {
+        patolette__COLOR_ICtCp_Matrix_to_Linear_Rec2020_Matrix(colors);
+        patolette__COLOR_Linear_Rec2020_Matrix_to_sRGB_Matrix(colors);
+    }
+}
+
+static void fill_hierarchy(
+    const patolette__ClusterTable *table,
+    size_t base_count,
+    size_t palette_size,
+    patolette__ColorSpace color_space,
+    bool palette_only,
+    patolette__PaletteHierarchy *hierarchy
+) {
+/*----------------------------------------------------------------------------
+    Writes the split hierarchy of a quantization.
+
+    @params
+    table - The cluster table, after local quantization.
+    base_count - The number of clusters before local quantization.
+    palette_size - The desired palette size.
+    color_space - The color space used for palette generation.
+    palette_only - Whether palette mapping is omitted. The palette is then
+    left in the color space used for palette generation, and so are split
+    colors, so that extracted palettes match it. Otherwise they are
+    converted to sRGB[0, 1].
+    hierarchy - The hierarchy to write.
+-----------------------------------------------------------------------------*/
+    size_t split_count = table->split_count;
+
+    patolette__Matrix2D *split_colors = patolette__Matrix2D_init(split_count, 3, NULL);
+    for (size_t s = 0; s < split_count; s++) {
+        size_t node = patolette__IndexArray_index(table->split_nodes, s);
+        for (size_t j = 0; j < 3; j++) {
+            patolette__Matrix2D_index(split_colors, s, j) = patolette__Matrix2D_index(table->center, node, j);
+        }
+        hierarchy->split_index[s] = patolette__IndexArray_index(table->split_slots, s);
+    }
+
+    if (!palette_only) {
+        convert_to_sRGB(split_colors, color_space);
+    }
+
+    for (size_t j = 0; j < 3; j++) {
+        for (size_t s = 0; s < split_count; s++) {
+            hierarchy->split_color[palette_size * j + s] = patolette__Matrix2D_index(split_colors, s, j);
+        }
+    }
+
+    hierarchy->base_count = base_count;
+    hierarchy->split_count = split_count;
+    patolette__Matrix2D_destroy(split_colors);
+}
+
 const char *get_patolette_exit_code_info_message(const int exit_code) {
 /*----------------------------------------------------------------------------
     Gets a success / error message from an exit code.
@@ -112,62 +274,81 @@ patolette__QuantizationOptions *patolette_create_default_options() {
     options->dither = true;
     options->palette_only = false;
     options->color_space = patolette__ICtCp;
+    options->weighting = patolette__WeightingSaliency;
+    options->tile_size = 512;
+    options->saliency_max_side = 0;
     options->kmeans_niter = 32;
+#ifdef PATOLETTE_WITH_FAISS
+    options->kmeans_engine = patolette__KMeansFAISS;
+#else
+    options->kmeans_engine = patolette__KMeansHamerly;
+#endif
+    options->kmeans_tolerance = 0;
+    options->kmeans_batch_size = 1024;
     options->kmeans_max_samples = SQ(512);
+    options->split_batch_ratio = 0;
+    options->generation_max_samples = 0;
+    options->pyramid_max_pixels = 0;
+    options->histogram_bits = 0;
+    options->target_distortion = 0;
+#ifdef PATOLETTE_WITH_FLANN
+    options->nn_engine = patolette__NNFLANN;
+#else
+    options->nn_engine = patolette__NNNative;
+#endif
     options->verbose = false;
     return options;
 }
 
-/**
- * Quantizes an image.
- *
- * @param width The width of the image.
- * @param height The height of the image.
- * @param color_data A (width * height, 3) matrix containing the image colors,
- *             scanned from left-to-right, top-to-bottom in sRGB[0, 1] space. The matrix
- *             must be stored column-major, i.e all red values come first, followed by all
- *             green values, followed by all blue values.
- * @param weight_data The weight of each color. All weights are expected to be in the
- *             range [1, inf].
- * @param palette_size The desired palette size, or the number of colors to
- *                     quantize the image to.
- * @param options Quantization options.
- *  - dither: Whether dithering is desired.
- *  - palette_only: When true, only the color palette is generated, and palette
- *                  mapping is omitted.
- *  - color_space: The color space to use for quantization. Only used for palette
- *                 generation; dithering is always performed in Linear Rec2020,
- *                 nearest neighbour mapping (when dithering is disabled) in ICtCp.
- *  - kmeans_niter: Number of KMeans refinement iterations to perform. Anything <= 0 yields no KMeans
-                    refinement.
- *  - kmeans_max_samples: Maximum number of samples to use when performing KMeans refinement. There's
- *                        a hard minimum of 256 ** 2.
- *  - verbose: Whether to print progress to the console.
- * @param palette_map A previously allocated array of length width * height.
- *                    The palette map is written here.
- * @param palette A previously allocated (palette_size, 3) matrix.
- *                The generated color palette is written here. Colors are written in
- *                sRGB[0,1] space.
- *                Some entries in the palette may be irrelevant, e.g width * height < palette_size.
- *                Non relevant entries take the value of an out of range sRGB[0, 1] color, i.e [-1, -1, -1].
- *                The matrix is written column-major, i.e all red values come first, followed by all
- *                green values, followed by all blue values.
- * @param exit_code Exit code. Zero if successful, non-zero otherwise.
- */
-void patolette(
+static const patolette__WeightMap *get_dense_map(
+    const double *weight_data,
+    patolette__WeightMap *map
+) {
+/*----------------------------------------------------------------------------
+    Describes one weight per pixel as a weight map.
+
+    @params
+    weight_data - The weight of each pixel, or NULL.
+    map - The map to fill.
+
+    @note
+    Returns map, or NULL if weight_data is NULL.
+-----------------------------------------------------------------------------*/
+    if (weight_data == NULL) {
+        return NULL;
+    }
+
+    map->kind = patolette__WeightsDense;
+    map->data = weight_data;
+    map->grid_width = 0;
+    map->grid_height = 0;
+    map->grid_cell_size = 0;
+    map->scale = 0;
+    map->region_count = 0;
+    return map;
+}
+
+static void quantize(
     size_t width,
     size_t height,
     const double *color_data,
-    const double *weight_data,
+    const patolette__WeightMap *weight_map,
     size_t palette_size,
     const patolette__QuantizationOptions *options,
     double *palette,
     size_t *palette_map,
+    size_t *result_size,
+    patolette__PaletteHierarchy *hierarchy,
     int *exit_code
 ) {
+/*----------------------------------------------------------------------------
+    Quantizes an image. Check patolette, patolette_with_hierarchy and
+    patolette_with_weight_map.
+-----------------------------------------------------------------------------*/
     validate_arguments(
         width,
         height,
+        weight_map,
         palette_size,
         options,
         exit_code
@@ -177,71 +358,205 @@ void patolette(
         return;
     }
 
+    if (hierarchy != NULL) {
+        hierarchy->base_count = 0;
+        hierarchy->split_count = 0;
+    }
+
+    // Temporaries are allocated from arenas, released all at once below
+    patolette__ARENA_begin();
+
     bool dither = options->dither;
     bool palette_only = options->palette_only;
     patolette__ColorSpace color_space = options->color_space;
+    patolette__Weighting weighting = options->weighting;
+    double tile_size = options->tile_size;
+    size_t saliency_max_side = options->saliency_max_side;
     int kmeans_niter = options->kmeans_niter;
-    size_t kmeans_max_samples = options->kmeans_max_samples;
+    patolette__KMeansEngine kmeans_engine = options->kmeans_engine;
+    patolette__NNEngine nn_engine = options->nn_engine;
+    double split_batch_ratio = options->split_batch_ratio;
+    size_t generation_max_samples = options->generation_max_samples;
+    size_t pyramid_max_pixels = options->pyramid_max_pixels;
+    int histogram_bits = options->histogram_bits;
+    double target_distortion = options->target_distortion;
     bool verbose = options->verbose;
 
+    patolette__KMeansParameters kmeans_params;
+    kmeans_params.niter = kmeans_niter;
+    kmeans_params.tolerance = options->kmeans_tolerance;
+    kmeans_params.batch_size = options->kmeans_batch_size;
+    kmeans_params.max_samples = options->kmeans_max_samples;
+    kmeans_params.verbose = verbose;
+
     patolette__Matrix2D *colors = patolette__Matrix2D_init(
         width * height,
         3,
         color_data
     );
 
-    patolette__Vector *weights = NULL;
-    if (weight_data != NULL) {
-        weights = patolette__Vector_init(width * height);
-        for (size_t i = 0; i < weights->length; i++) {
-            patolette__Vector_index(weights, i) = weight_data[i];
+    patolette__Weights *weights = NULL;
+    if (weight_map != NULL) {
+        weights = patolette__Weights_init(weight_map, width, height, NULL);
+    }
+
+    else if (tile_size > 0 && weighting == patolette__WeightingDensity) {
+        if (verbose) {
+            printf("patolette ======== Generating color density map\n");
         }
+
+        weights = patolette__DENSITY_weights(colors, width, height, tile_size);
     }
 
-    if (color_space == patolette__CIELuv) {
-        patolette__COLOR_sRGB_Matrix_to_CIELuv_Matrix(colors);
+    else if (tile_size > 0) {
+        if (verbose) {
+            printf("patolette ======== Generating saliency map\n");
+        }
+
+        weights = patolette__SALIENCY_weights(
+            colors,
+            width,
+            height,
+            tile_size,
+            saliency_max_side
+        );
     }
 
-    else if (color_space == patolette__ICtCp) {
-        patolette__COLOR_sRGB_Matrix_to_ICtCp_Matrix(colors);
+    // The colors the palette is generated from, and the dimensions of
+    // the (possibly downscaled) image they come from
+    patolette__Matrix2D *generation_colors = colors;
+    patolette__Weights *generation_weights = weights;
+    size_t generation_width = width;
+    size_t generation_height = height;
+
+    bool pyramid = pyramid_max_pixels > 0 && colors->rows > pyramid_max_pixels;
+    if (pyramid) {
+        if (verbose) {
+            printf("patolette ======== Downscaling\n");
+        }
+
+        patolette__Vector *level_weights = NULL;
+        generation_colors = patolette__PYRAMID_downscale(
+            colors,
+            weights,
+            width,
+            height,
+            pyramid_max_pixels,
+            &generation_width,
+            &generation_height,
+            &level_weights
+        );
+
+        generation_weights = patolette__Weights_from_vector(level_weights);
+
+        convert_from_sRGB(generation_colors, color_space);
+    }
+
+    convert_from_sRGB(colors, color_space);
+
+    if (generation_max_samples > 0 && generation_colors->rows > generation_max_samples) {
+        if (verbose) {
+            printf("patolette ======== Sampling\n");
+        }
+
+        patolette__Vector *sample_weights = NULL;
+        patolette__Matrix2D *samples = patolette__SAMPLE_stratified(
+            generation_colors,
+            generation_weights,
+            generation_width,
+            generation_height,
+            generation_max_samples,
+            &sample_weights
+        );
+
+        if (generation_colors != colors) {
+            patolette__Matrix2D_destroy(generation_colors);
+            patolette__Weights_destroy(generation_weights);
+        }
+
+        generation_colors = samples;
+        generation_weights = patolette__Weights_from_vector(sample_weights);
+    }
+
+    // Scatter of the colors each generation color stands for, if binned
+    patolette__Vector *generation_scatter = NULL;
+
+    if (histogram_bits > 0) {
+        if (verbose) {
+            printf("patolette ======== Binning\n");
+        }
+
+        patolette__Vector *bin_weights = NULL;
+        patolette__Matrix2D *bins = patolette__HISTOGRAM_bin(
+            generation_colors,
+            generation_weights,
+            histogram_bits,
+            &bin_weights,
+            &generation_scatter
+        );
+
+        if (generation_colors != colors) {
+            patolette__Matrix2D_destroy(generation_colors);
+            patolette__Weights_destroy(generation_weights);
+        }
+
+        generation_colors = bins;
+        generation_weights = patolette__Weights_from_vector(bin_weights);
     }
 
     if (verbose) {
         printf("patolette ======== Palette generation \n");
     }
 
-    patolette__ColorClusterArray *gq_clusters = patolette__GQ_quantize(
-        colors,
-        weights,
+    patolette__ClusterTable *clusters = patolette__GQ_quantize(
+        generation_colors,
+        generation_weights,
+        generation_scatter,
+        generation_colors != colors,
         palette_size
     );
 
-    if (gq_clusters == NULL) {
+    if (clusters == NULL) {
         // Error
         *exit_code = bad_quant;
-        patolette__Vector_destroy(weights);
+        if (generation_colors != colors) {
+            patolette__Matrix2D_destroy(generation_colors);
+            patolette__Weights_destroy(generation_weights);
+        }
+        patolette__Vector_destroy(generation_scatter);
+        patolette__Weights_destroy(weights);
         patolette__Matrix2D_destroy(colors);
+        patolette__ARENA_end();
         return;
     }
 
     if (verbose) {
-        printf("patolette ======== Base cluster count: %zu\n", gq_clusters->length);
+        printf("patolette ======== Base cluster count: %zu\n", clusters->length);
     }
 
-    patolette__ColorClusterArray *clusters = patolette__LQ_quantize(
-        gq_clusters,
+    size_t base_count = clusters->length;
+
+    patolette__LQ_quantize(
+        clusters,
         palette_size,
+        split_batch_ratio,
+        target_distortion,
         verbose
     );
 
-    if (clusters == NULL) {
-        // Error
-        *exit_code = bad_quant;
+    if (verbose) {
+        printf("patolette ======== Palette size: %zu\n", clusters->length);
+    }
 
-        patolette__Matrix2D_destroy(colors);
-        patolette__Vector_destroy(weights);
-        patolette__ColorClusterArray_destroy_deep(gq_clusters);
-        return;
+    if (hierarchy != NULL) {
+        fill_hierarchy(
+            clusters,
+            base_count,
+            palette_size,
+            color_space,
+            palette_only,
+            hierarchy
+        );
     }
 
     patolette__Matrix2D *palette_colors;
@@ -250,20 +565,40 @@ void patolette(
             printf("patolette ======== KMeans refinement\n");
         }
 
-        palette_colors = patolette__PALETTE_get_refined_palette(
-            colors,
-            weights,
-            clusters,
-            kmeans_niter,
-            kmeans_max_samples,
-            verbose
-        );
+        if (pyramid) {
+            // Warm-started at full resolution
+            patolette__Matrix2D *initial = patolette__PALETTE_create(clusters);
+            palette_colors = patolette__PALETTE_refine(
+                colors,
+                weights,
+                initial,
+                patolette__PALETTE_get_refine_backend(kmeans_engine),
+                &kmeans_params
+            );
+            patolette__Matrix2D_destroy(initial);
+        }
+
+        else {
+            palette_colors = patolette__PALETTE_get_refined_palette(
+                generation_colors,
+                generation_weights,
+                clusters,
+                patolette__PALETTE_get_refine_backend(kmeans_engine),
+                &kmeans_params
+            );
+        }
     }
 
     else {
         palette_colors = patolette__PALETTE_create(clusters);
     }
 
+    if (generation_colors != colors) {
+        patolette__Matrix2D_destroy(generation_colors);
+        patolette__Weights_destroy(generation_weights);
+    }
+    patolette__Vector_destroy(generation_scatter);
+
     if (!palette_only) {
         if (dither) {
 
@@ -291,7 +626,8 @@ void patolette(
                 width,
                 height,
                 palette_colors,
-                palette_map
+                palette_map,
+                patolette__PALETTE_get_nn_backend(nn_engine)
             );
 
             patolette__COLOR_Linear_Rec2020_Matrix_to_sRGB_Matrix(colors);
@@ -313,9 +649,15 @@ void patolette(
                 patolette__COLOR_sRGB_Matrix_to_ICtCp_Matrix(palette_colors);
             }
 
+            else if (color_space == patolette__sRGB) {
+                patolette__COLOR_sRGB_Matrix_to_ICtCp_Matrix(colors);
+                patolette__COLOR_sRGB_Matrix_to_ICtCp_Matrix(palette_colors);
+            }
+
             patolette__PALETTE_fill_palette_map_nearest(
                 colors,
                 palette_colors,
+                patolette__PALETTE_get_nn_backend(nn_engine),
                 palette_map
             );
 
@@ -335,9 +677,294 @@ void patolette(
         }
     }
 
+    if (result_size != NULL) {
+        *result_size = palette_colors->rows;
+    }
+
     patolette__Matrix2D_destroy(colors);
     patolette__Matrix2D_destroy(palette_colors);
-    patolette__Vector_destroy(weights);
-    patolette__ColorClusterArray_destroy_deep(clusters);
+    patolette__Weights_destroy(weights);
+    patolette__ClusterTable_destroy(clusters);
+    patolette__ARENA_end();
     *exit_code = success;
-}
\ No newline at end of file
+}
+
+/**
+ * Quantizes an image.
+ *
+ * @param width The width of the image.
+ * @param height The height of the image.
+ * @param color_data A (width * height, 3) matrix containing the image colors,
+ *             scanned from left-to-right, top-to-bottom in sRGB[0, 1] space. The matrix
+ *             must be stored column-major, i.e all red values come first, followed by all
+ *             green values, followed by all blue values.
+ * @param weight_data The weight of each color, or NULL. All weights are expected to be in the
+ *             range [1, inf]. Takes precedence over options->tile_size. For compact weights,
+ *             check patolette_with_weight_map.
+ * @param palette_size The desired palette size, or the number of colors to
+ *                     quantize the image to.
+ * @param options Quantization options.
+ *  - dither: Whether dithering is desired.
+ *  - palette_only: When true, only the color palette is generated, and palette
+ *                  mapping is omitted. The palette is then left in the color space
+ *                  used for palette generation.
+ *  - color_space: The color space to use for quantization. Only used for palette
+ *                 generation; dithering is always performed in Linear Rec2020,
+ *                 nearest neighbour mapping (when dithering is disabled) in ICtCp.
+ *  - weighting: How colors are weighted when tile_size > 0 and no weights are supplied.
+ *               patolette__WeightingSaliency computes a saliency map, so visually striking
+ *               areas are given higher weight; patolette__WeightingDensity gives colors that
+ *               are rare in color space higher weight. It needs no spatial processing, just
+ *               a color histogram, so it is much cheaper, especially on large images.
+ *  - tile_size: Tile size in the range [0, inf]. When > 0 and no weights are supplied, colors
+ *               are weighted as per weighting. The lower the tile size, the more exaggerated
+ *               the effect. Anything <= 0 disables it.
+ *  - saliency_max_side: When > 0, the saliency map is computed on a copy of the image downscaled
+ *                       (by an integer factor) to at most this many pixels on its longer side, and
+ *                       its weights are bilinearly upsampled. Much faster on large images, at the
+ *                       cost of finer detail. 0 computes it at full resolution.
+ *  - kmeans_niter: Number of KMeans refinement iterations to perform. Anything <= 0 yields no KMeans
+                    refinement.
+ *  - kmeans_engine: The KMeans engine to use for refinement. patolette__KMeansFAISS runs FAISS
+ *                   (brute force assignment); patolette__KMeansHamerly runs a native engine that
+ *                   uses distance bounds to skip most distance computations, and is much faster for
+ *                   large palettes; patolette__KMeansMiniBatch runs mini-batch KMeans (kmeans_niter
+ *                   batches of kmeans_batch_size samples), followed by one full iteration, for huge
+ *                   palettes and inputs. Builds may omit FAISS, in which case the default is
+ *                   patolette__KMeansHamerly.
+ *  - kmeans_tolerance: When > 0, KMeans refinement stops early once the relative objective
+ *                      improvement, or the largest center shift (in the color space used for
+ *                      palette generation), of an iteration is at most this. Anything <= 0 runs
+ *                      all kmeans_niter iterations. The mini-batch engine only checks the center
+ *                      shift.
+ *  - kmeans_batch_size: Number of samples in each batch, for the mini-batch KMeans engine.
+ *  - kmeans_max_samples: Maximum number of samples to use when performing KMeans refinement. There's
+ *                        a hard minimum of 256 ** 2.
+ *  - split_batch_ratio: Fraction of the remaining palette budget to split at once in each round of
+ *                       local quantization, in the range [0, 1]. Anything <= 0 splits one cluster at
+ *                       a time (exact greedy order). Higher values are faster for large palettes, at
+ *                       some cost in quality.
+ *  - generation_max_samples: Maximum number of colors to generate the palette from. Larger images are
+ *                            sampled (spatially stratified) down to about this many colors, and the
+ *                            full image is then mapped / dithered against the resulting palette.
+ *                            Anything <= 0 uses all colors.
+ *  - pyramid_max_pixels: Pixel budget for palette generation. Larger images are downscaled by
+ *                        factors of 2 (box filter, in linear light) until under budget, and the
+ *                        palette is generated there. KMeans refinement, if any, is then warm-started
+ *                        from that palette at full resolution. Anything <= 0 disables downscaling.
+ *  - histogram_bits: When > 0, colors are binned into a 3D histogram with this many bits per axis
+ *                    (clamped to [5, 7]) in the generation color space, and the palette is generated
+ *                    from the occupied bins as weighted colors. Bins keep their second moments, so
+ *                    cluster distortions stay exact. They only keep their total spread though, not
+ *                    its direction, so split axes are those of the bin means. Anything <= 0
+ *                    disables binning.
+ *  - target_distortion: When > 0, cluster splitting stops as soon as the mean (weighted) squared
+ *                       error of the palette, in the color space used for palette generation, is
+ *                       at most this, so the palette may end up smaller than palette_size. KMeans
+ *                       refinement then runs on the resulting size (check patolette_with_hierarchy). Anything
+ *                       <= 0 disables it.
+ *  - nn_engine: The nearest neighbour engine to use for palette mapping and dithering.
+ *               patolette__NNFLANN runs FLANN (KD-tree); patolette__NNNative runs an exact
+ *               search over palette colors sorted by norm, with no dependencies.
+ *  - verbose: Whether to print progress to the console.
+ * @param palette_map A previously allocated array of length width * height.
+ *                    The palette map is written here.
+ * @param palette A previously allocated (palette_size, 3) matrix.
+ *                The generated color palette is written here. Colors are written in
+ *                sRGB[0,1] space.
+ *                Some entries in the palette may be irrelevant, e.g width * height < palette_size,
+ *                or target_distortion was reached with fewer colors. Relevant entries always come
+ *                first (patolette_with_hierarchy reports how many there are).
+ *                Non relevant entries take the value of an out of range sRGB[0, 1] color, i.e [-1, -1, -1].
+ *                The matrix is written column-major, i.e all red values come first, followed by all
+ *                green values, followed by all blue values.
+ * @param exit_code Exit code. Zero if successful, non-zero otherwise.
+ */
+void patolette(
+    size_t width,
+    size_t height,
+    const double *color_data,
+    const double *weight_data,
+    size_t palette_size,
+    const patolette__QuantizationOptions *options,
+    double *palette,
+    size_t *palette_map,
+    int *exit_code
+) {
+    patolette__WeightMap map;
+    quantize(
+        width,
+        height,
+        color_data,
+        get_dense_map(weight_data, &map),
+        palette_size,
+        options,
+        palette,
+        palette_map,
+        NULL,
+        NULL,
+        exit_code
+    );
+}
+
+/**
+ * Quantizes an image, and also outputs the split hierarchy the palette was
+ * built with, from which the palette (and palette map) of any smaller size
+ * down to hierarchy->base_count can be extracted cheaply. Check
+ * patolette_hierarchy_extract_palette and patolette_hierarchy_get_remap.
+ *
+ * @param result_size On exit, the size of the resulting palette, i.e the number of relevant
+ *                    palette entries (at most palette_size), or NULL.
+ * @param hierarchy The split hierarchy, or NULL. Its split_index and split_color arrays
+ *                  must be previously allocated, of lengths palette_size and palette_size * 3.
+ *                  The rest of the parameters are as in patolette.
+ *
+ * @note With split_batch_ratio > 0 the extracted palettes follow the batched split
+ *       order, which is not exactly the greedy one. Extracted palettes use unrefined
+ *       cluster centers for merged entries, so with KMeans refinement they mix
+ *       refined and unrefined colors.
+ */
+void patolette_with_hierarchy(
+    size_t width,
+    size_t height,
+    const double *color_data,
+    const double *weight_data,
+    size_t palette_size,
+    const patolette__QuantizationOptions *options,
+    double *palette,
+    size_t *palette_map,
+    size_t *result_size,
+    patolette__PaletteHierarchy *hierarchy,
+    int *exit_code
+) {
+    patolette__WeightMap map;
+    quantize(
+        width,
+        height,
+        color_data,
+        get_dense_map(weight_data, &map),
+        palette_size,
+        options,
+        palette,
+        palette_map,
+        result_size,
+        hierarchy,
+        exit_code
+    );
+}
+
+/**
+ * Quantizes an image, weighting its colors by a weight map. Maps can be
+ * compact (a low resolution grid, quantized values, or a list of regions), and
+ * are evaluated where weights are used, so they're never expanded to one
+ * double per pixel (palette generation keeps a single precision copy). Check
+ * patolette__WeightMap.
+ *
+ * @param weight_map The weight map, or NULL. Takes precedence over options->tile_size.
+ * @param result_size As in patolette_with_hierarchy.
+ * @param hierarchy The split hierarchy, as in patolette_with_hierarchy, or NULL.
+ *                  The rest of the parameters are as in patolette.
+ */
+void patolette_with_weight_map(
+    size_t width,
+    size_t height,
+    const double *color_data,
+    const patolette__WeightMap *weight_map,
+    size_t palette_size,
+    const patolette__QuantizationOptions *options,
+    double *palette,
+    size_t *palette_map,
+    size_t *result_size,
+    patolette__PaletteHierarchy *hierarchy,
+    int *exit_code
+) {
+    quantize(
+        width,
+        height,
+        color_data,
+        weight_map,
+        palette_size,
+        options,
+        palette,
+        palette_map,
+        result_size,
+        hierarchy,
+        exit_code
+    );
+}
+
+/**
+ * Extracts a smaller palette from a palette and its split hierarchy, by
+ * undoing the splits made after the palette had the requested size.
+ *
+ * @param hierarchy The split hierarchy.
+ * @param palette The (palette_size, 3) palette, as written by patolette_with_hierarchy.
+ * @param palette_size The palette size quantization was run with.
+ * @param size The size of the palette to extract, in the range
+ *             [hierarchy->base_count, hierarchy->base_count + hierarchy->split_count].
+ * @param sub_palette A previously allocated (size, 3) matrix, written column-major.
+ * @return Whether size is in range.
+ */
+bool patolette_hierarchy_extract_palette(
+    const patolette__PaletteHierarchy *hierarchy,
+    const double *palette,
+    size_t palette_size,
+    size_t size,
+    double *sub_palette
+) {
+    size_t base_count = hierarchy->base_count;
+    size_t length = base_count + hierarchy->split_count;
+    if (size < base_count || size > length) {
+        return false;
+    }
+
+    for (size_t j = 0; j < 3; j++) {
+        for (size_t i = 0; i < size; i++) {
+            sub_palette[size * j + i] = palette[palette_size * j + i];
+        }
+    }
+
+    // Latest first, so each entry ends up with its color at the time the
+    // palette had the requested size
+    for (size_t s = hierarchy->split_count; s-- > size - base_count;) {
+        size_t i = hierarchy->split_index[s];
+        if (i >= size) {
+            continue;
+        }
+
+        for (size_t j = 0; j < 3; j++) {
+            sub_palette[size * j + i] = hierarchy->split_color[palette_size * j + s];
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Gets the remapping from a palette's indices to those of a smaller palette
+ * extracted from it, i.e. sub_map[k] = remap[palette_map[k]].
+ *
+ * @param hierarchy The split hierarchy.
+ * @param size The size of the extracted palette. Check patolette_hierarchy_extract_palette.
+ * @param remap A previously allocated array of length
+ *              hierarchy->base_count + hierarchy->split_count.
+ * @return Whether size is in range.
+ */
+bool patolette_hierarchy_get_remap(
+    const patolette__PaletteHierarchy *hierarchy,
+    size_t size,
+    size_t *remap
+) {
+    size_t base_count = hierarchy->base_count;
+    size_t length = base_count + hierarchy->split_count;
+    if (size < base_count || size > length) {
+        return false;
+    }
+
+    // Entry i >= base_count was split off entry split_index[i - base_count] < i
+    for (size_t i = 0; i < length; i++) {
+        remap[i] = i < size ? i : remap[hierarchy->split_index[i - base_count]];
+    }
+
+    return true;
+}
@@ -27,6 +27,20 @@ static patolette__Matrix2D *patolette__CELLS_vcov(
     const patolette__CellMomentsCache *cache
 );
 
+static double get_axis_bias(
+    const patolette__Vector *cell_axis,
+    const patolette__Vector *axis
+);
+
+static patolette__CellMomentsCache *init_cache(size_t size);
+static void merge_cache(
+    patolette__CellMomentsCache *dest,
+    const patolette__CellMomentsCache *src
+);
+
+static size_t hash_cell(size_t a, size_t b);
+static void rehash_queries(patolette__CellQueryCache *queries, size_t table_size);
+
 /*----------------------------------------------------------------------------
     Declarations END
 -----------------------------------------------------------------------------*/
@@ -36,6 +50,49 @@ static patolette__Matrix2D *patolette__CELLS_vcov(
     Internal functions START
 -----------------------------------------------------------------------------*/
 
+static patolette__CellMomentsCache *init_cache(size_t size) {
+/*----------------------------------------------------------------------------
+    Initializes a zeroed CellMomentsCache object.
+
+    @params
+    size - The number of entries of the cache.
+-----------------------------------------------------------------------------*/
+    patolette__CellMomentsCache *cache = patolette__ARENA_malloc(sizeof(*cache));
+    cache->w0 = patolette__Vector_init(size);
+    cache->w1 = patolette__Matrix2D_init(3, size, NULL);
+    cache->w2 = patolette__Vector_init(size);
+    cache->wrs = patolette__Matrix3D_init(3, 3, size);
+    cache->size = size;
+    return cache;
+}
+
+static void merge_cache(
+    patolette__CellMomentsCache *dest,
+    const patolette__CellMomentsCache *src
+) {
+/*----------------------------------------------------------------------------
+    Adds the (non-cumulative) moments of a CellMomentsCache object into
+    another one of the same size.
+
+    @params
+    dest - The CellMomentsCache object to add into.
+    src - The CellMomentsCache object to add.
+-----------------------------------------------------------------------------*/
+    for (size_t i = 0; i < dest->size; i++) {
+        patolette__Vector_index(dest->w0, i) += patolette__Vector_index(src->w0, i);
+        patolette__Vector_index(dest->w2, i) += patolette__Vector_index(src->w2, i);
+
+        for (size_t s = 0; s < 3; s++) {
+            patolette__Matrix2D_index(dest->w1, s, i) += patolette__Matrix2D_index(src->w1, s, i);
+
+            for (size_t r = 0; r <= s; r++) {
+                double v = patolette__Matrix3D_index(src->wrs, r, s, i);
+                patolette__Matrix3D_index(dest->wrs, r, s, i) += v;
+            }
+        }
+    }
+}
+
 void patolette__CellMomentsCache_destroy(patolette__CellMomentsCache *cache) {
 /*----------------------------------------------------------------------------
     Destroys a CellMomentsCache object
@@ -43,80 +100,145 @@ void patolette__CellMomentsCache_destroy(patolette__CellMomentsCache *cache) {
     @params
     cache - The CellMomentsCache object.
 -----------------------------------------------------------------------------*/
-    patolette__UInt64Array_destroy(cache->w0);
+    patolette__Vector_destroy(cache->w0);
     patolette__Matrix2D_destroy(cache->w1);
     patolette__Vector_destroy(cache->w2);
     patolette__Matrix3D_destroy(cache->wrs);
-    free(cache);
+    patolette__ARENA_free(cache);
 }
 
 patolette__CellMomentsCache *patolette__CELLS_preprocess(
     const patolette__Matrix2D *colors,
-    const patolette__IndexArray *bucket_map,
-    size_t bucket_count
+    const patolette__Vector *weights,
+    const patolette__Vector *scatter,
+    const patolette__Vector *axis,
+    size_t bucket_count,
+    patolette__UInt16Array **bucket_map
 ) {
 /*----------------------------------------------------------------------------
     Constructs the CellMomentsCache object needed to perform queries
     on the cells of the global principal quantizer.
 
+    The colors are bucket-sorted based on their individual projections
+    onto the supplied axis in the same pass that accumulates the moments
+    of each bucket.
+
     @params
     colors - A list of colors.
-    bucket_map - Describes a bucket sorting of the colors based on their
-    individual projections onto the color set's principal axis.
-    bucket_count - The number of buckets used to sort the colors.
+    weights - Weight of each color, or NULL (all colors weigh 1).
+    scatter - The (weighted) scatter of the colors each color stands for,
+    e.g. when colors are histogram bins, or NULL.
+    axis - The color set's principal axis.
+    bucket_count - The number of buckets used to sort the colors (at most
+    65536).
+    bucket_map - On exit, describes a bucket sorting of the colors based
+    on their individual projections onto the supplied axis.
 
     @note
     For queries (0, k] to work as intended, we use 1-based indexing
-    for the bucket map.
+    for the cache (but not for the bucket map).
+
+    @note
+    Scatter only adds to the second moments' trace (w2), which is all
+    distortions need. It carries no direction, so it's left out of the
+    cross moments (wrs) that principal axes come from.
+
+    @note
+    Each thread accumulates into its own private moments, which are
+    reduced in thread order afterwards, so results are deterministic
+    for a given thread count.
 -----------------------------------------------------------------------------*/
-    patolette__CellMomentsCache *cache = malloc(sizeof(*cache));
+    size_t rows = colors->rows;
 
     // Check @note for why bucket_count + 1 is used
     size_t size = bucket_count + 1;
-    cache->w0 = patolette__UInt64Array_init(size);
-    cache->w1 = patolette__Matrix2D_init(3, size, NULL);
-    cache->w2 = patolette__Vector_init(size);
-    cache->wrs = patolette__Matrix3D_init(3, 3, size);
-    cache->size = size;
 
-    patolette__UInt64Array *w0 = cache->w0;
-    patolette__Matrix2D *w1 = cache->w1;
-    patolette__Vector *w2 = cache->w2;
-    patolette__Matrix3D *wrs = cache->wrs;
+    patolette__AxisBucketing bucketing = patolette__SORT_get_bucketing(
+        &patolette__Matrix2D_index(colors, 0, 0),
+        &patolette__Matrix2D_index(colors, 0, 1),
+        &patolette__Matrix2D_index(colors, 0, 2),
+        rows,
+        axis,
+        bucket_count
+    );
 
-    size_t rows = colors->rows;
-    for (size_t i = 0; i < rows; i++) {
-        size_t j = patolette__IndexArray_index(bucket_map, i) + 1;
-
-        double cx = patolette__Matrix2D_index(colors, i, 0);
-        double cy = patolette__Matrix2D_index(colors, i, 1);
-        double cz = patolette__Matrix2D_index(colors, i, 2);
-
-        patolette__UInt64Array_index(w0, j) += 1;
-        patolette__Matrix2D_index(w1, 0, j) += cx;
-        patolette__Matrix2D_index(w1, 1, j) += cy;
-        patolette__Matrix2D_index(w1, 2, j) += cz;
-        patolette__Vector_index(w2, j) += (
-            SQ(cx) +
-            SQ(cy) +
-            SQ(cz)
-        );
-    }
+    patolette__UInt16Array *map = patolette__UInt16Array_init(rows);
 
-    for (size_t i = 0; i < rows; i++) {
-        size_t j = patolette__IndexArray_index(bucket_map, i) + 1;
+    int thread_count = omp_get_max_threads();
+    patolette__CellMomentsCache **partials = patolette__ARENA_calloc(
+        (size_t)thread_count,
+        sizeof(patolette__CellMomentsCache*)
+    );
 
-        for (size_t s = 0; s < 3; s++) {
-            for (size_t r = 0; r <= s; r++) {
-                double cr = patolette__Matrix2D_index(colors, i, r);
-                double cs = patolette__Matrix2D_index(colors, i, s);
-                patolette__Matrix3D_index(wrs, r, s, j) += cr * cs;
+    #pragma omp parallel num_threads(thread_count)
+    {
+        patolette__CellMomentsCache *partial = init_cache(size);
+        partials[omp_get_thread_num()] = partial;
+
+        patolette__Vector *w0 = partial->w0;
+        patolette__Matrix2D *w1 = partial->w1;
+        patolette__Vector *w2 = partial->w2;
+        patolette__Matrix3D *wrs = partial->wrs;
+
+        #pragma omp for schedule(static)
+        for (size_t i = 0; i < rows; i++) {
+            double c[3] = {
+                patolette__Matrix2D_index(colors, i, 0),
+                patolette__Matrix2D_index(colors, i, 1),
+                patolette__Matrix2D_index(colors, i, 2)
+            };
+
+            size_t bucket = patolette__SORT_bucket(&bucketing, i, c[0], c[1], c[2]);
+            patolette__UInt16Array_index(map, i) = (uint16_t)bucket;
+
+            double w = weights == NULL ? 1 : patolette__Vector_index(weights, i);
+            double sc = scatter == NULL ? 0 : patolette__Vector_index(scatter, i);
+
+            size_t j = bucket + 1;
+            patolette__Vector_index(w0, j) += w;
+            patolette__Matrix2D_index(w1, 0, j) += w * c[0];
+            patolette__Matrix2D_index(w1, 1, j) += w * c[1];
+            patolette__Matrix2D_index(w1, 2, j) += w * c[2];
+            patolette__Vector_index(w2, j) += w * (
+                SQ(c[0]) +
+                SQ(c[1]) +
+                SQ(c[2])
+            ) + sc;
+
+            for (size_t s = 0; s < 3; s++) {
+                for (size_t r = 0; r <= s; r++) {
+                    patolette__Matrix3D_index(wrs, r, s, j) += w * c[r] * c[s];
+                }
             }
         }
     }
 
+    patolette__CellMomentsCache *cache = NULL;
+    for (int t = 0; t < thread_count; t++) {
+        patolette__CellMomentsCache *partial = partials[t];
+
+        if (partial == NULL) {
+            continue;
+        }
+
+        if (cache == NULL) {
+            cache = partial;
+            continue;
+        }
+
+        merge_cache(cache, partial);
+        patolette__CellMomentsCache_destroy(partial);
+    }
+
+    patolette__ARENA_free(partials);
+
+    patolette__Vector *w0 = cache->w0;
+    patolette__Matrix2D *w1 = cache->w1;
+    patolette__Vector *w2 = cache->w2;
+    patolette__Matrix3D *wrs = cache->wrs;
+
     for (size_t i = 1; i < size; i++) {
-        patolette__UInt64Array_index(w0, i) += patolette__UInt64Array_index(w0, i - 1);
+        patolette__Vector_index(w0, i) += patolette__Vector_index(w0, i - 1);
         patolette__Vector_index(w2, i) += patolette__Vector_index(w2, i - 1);
     }
 
@@ -135,6 +257,7 @@ patolette__CellMomentsCache *patolette__CELLS_preprocess(
         }
     }
 
+    *bucket_map = map;
     return cache;
 }
 
@@ -151,14 +274,14 @@ double patolette__CELLS_get_cell_distortion(
     b - The upper end of the cell.
     cache - The CellMomentsCache object.
 -----------------------------------------------------------------------------*/
-    patolette__UInt64Array *w0 = cache->w0;
+    patolette__Vector *w0 = cache->w0;
     patolette__Matrix2D *w1 = cache->w1;
     patolette__Vector *w2 = cache->w2;
 
-    uint64_t w0a = patolette__UInt64Array_index(w0, a);
-    uint64_t w0b = patolette__UInt64Array_index(w0, b);
+    double w0a = patolette__Vector_index(w0, a);
+    double w0b = patolette__Vector_index(w0, b);
     
-    if (w0a == w0b) {
+    if (w0b - w0a <= 0) {
         return 0;
     }
 
@@ -177,7 +300,7 @@ double patolette__CELLS_get_cell_distortion(
             SQ(w10b - w10a) +
             SQ(w11b - w11a) +
             SQ(w12b - w12a)
-        ) / (double)(w0b - w0a)
+        ) / (w0b - w0a)
     );
 }
 
@@ -198,14 +321,14 @@ static double eval_vcov(
     s - The column to evaluate.
     cache - The CellMomentsCache object.
 -----------------------------------------------------------------------------*/
-    patolette__UInt64Array *w0 = cache->w0;
+    patolette__Vector *w0 = cache->w0;
     patolette__Matrix2D *w1 = cache->w1;
     patolette__Matrix3D *wrs = cache->wrs;
 
-    uint64_t w0a = patolette__UInt64Array_index(w0, a);
-    uint64_t w0b = patolette__UInt64Array_index(w0, b);
+    double w0a = patolette__Vector_index(w0, a);
+    double w0b = patolette__Vector_index(w0, b);
     
-    if (w0a == w0b) {
+    if (w0b - w0a <= 0) {
         return 0;
     }
 
@@ -217,8 +340,8 @@ static double eval_vcov(
     double w1sb = patolette__Matrix2D_index(w1, s, b);
 
     return (
-        (wrsb - wrsa) / (double)(w0b - w0a) -
-        (w1rb - w1ra) * (w1sb - w1sa) / SQ((double)(w0b - w0a))
+        (wrsb - wrsa) / (w0b - w0a) -
+        (w1rb - w1ra) * (w1sb - w1sa) / SQ(w0b - w0a)
     );
 }
 
@@ -249,6 +372,72 @@ static patolette__Matrix2D *patolette__CELLS_vcov(
     return vcov;
 }
 
+static double get_axis_bias(
+    const patolette__Vector *cell_axis,
+    const patolette__Vector *axis
+) {
+/*----------------------------------------------------------------------------
+    Gets the bias of a cell's principal axis towards a supplied axis,
+    i.e. the absolute cosine of the angle between them.
+
+    @params
+    cell_axis - The cell's principal axis.
+    axis - The axis to compare to.
+-----------------------------------------------------------------------------*/
+    double axis_norm = patolette__Vector_norm(axis);
+    double cell_axis_norm = patolette__Vector_norm(cell_axis);
+    double norms = axis_norm * cell_axis_norm;
+
+    if (norms < patolette__DELTA) {
+        return 0;
+    }
+
+    double dot = (
+        patolette__Vector_index(cell_axis, 0) * patolette__Vector_index(axis, 0) +
+        patolette__Vector_index(cell_axis, 1) * patolette__Vector_index(axis, 1) +
+        patolette__Vector_index(cell_axis, 2) * patolette__Vector_index(axis, 2)
+    );
+
+    double cos = dot / norms;
+    return fmin(1, fabs(cos));
+}
+
+static size_t hash_cell(size_t a, size_t b) {
+/*----------------------------------------------------------------------------
+    Hashes a cell (a, b).
+
+    @params
+    a - The lower end of the cell.
+    b - The upper end of the cell.
+-----------------------------------------------------------------------------*/
+    uint64_t h = ((uint64_t)a << 32) ^ (uint64_t)b;
+    h *= 0x9E3779B97F4A7C15ULL;
+    return (size_t)(h >> 32);
+}
+
+static void rehash_queries(patolette__CellQueryCache *queries, size_t table_size) {
+/*----------------------------------------------------------------------------
+    Rebuilds the open addressing table of a CellQueryCache.
+
+    @params
+    queries - The CellQueryCache object.
+    table_size - The new table size (must be a power of two).
+-----------------------------------------------------------------------------*/
+    patolette__ARENA_free(queries->table);
+    queries->table = patolette__ARENA_calloc(table_size, sizeof(size_t));
+    queries->table_size = table_size;
+
+    size_t mask = table_size - 1;
+    for (size_t i = 0; i < queries->length; i++) {
+        patolette__CellQuery *query = &queries->queries[i];
+        size_t slot = hash_cell(query->a, query->b) & mask;
+        while (queries->table[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        queries->table[slot] = i + 1;
+    }
+}
+
 /*----------------------------------------------------------------------------
     Internal functions END
 -----------------------------------------------------------------------------*/
@@ -302,29 +491,158 @@ double patolette__CELLS_get_cell_bias(
         return -1;
     }
 
-    double result;
+    double result = get_axis_bias(pca->axis, axis);
 
-    double axis_norm = patolette__Vector_norm(axis);
-    double cell_axis_norm = patolette__Vector_norm(pca->axis);
-    double norms = axis_norm * cell_axis_norm;
+    patolette__PCA_destroy(pca);
+    return result;
+}
 
-    if (norms < patolette__DELTA) {
-        result = 0;
+void patolette__CellQueryCache_destroy(patolette__CellQueryCache *queries) {
+/*----------------------------------------------------------------------------
+    Destroys a CellQueryCache object.
+
+    @params
+    queries - The CellQueryCache object.
+-----------------------------------------------------------------------------*/
+    if (queries == NULL) {
+        return;
+    }
+
+    patolette__ARENA_free(queries->queries);
+    patolette__ARENA_free(queries->table);
+    patolette__ARENA_free(queries);
+}
+
+patolette__CellQueryCache *patolette__CellQueryCache_init(size_t capacity) {
+/*----------------------------------------------------------------------------
+    Initializes an empty CellQueryCache object.
+
+    @params
+    capacity - The number of queries to make room for initially. The
+    cache grows as needed.
+-----------------------------------------------------------------------------*/
+    patolette__CellQueryCache *queries = patolette__ARENA_malloc(sizeof *queries);
+    capacity = max(capacity, 1);
+
+    queries->queries = patolette__ARENA_malloc(sizeof(patolette__CellQuery) * capacity);
+    queries->length = 0;
+    queries->capacity = capacity;
+
+    size_t table_size = 1;
+    while (table_size < 2 * capacity) {
+        table_size <<= 1;
+    }
+
+    queries->table = NULL;
+    rehash_queries(queries, table_size);
+    return queries;
+}
+
+size_t patolette__CellQueryCache_get(
+    patolette__CellQueryCache *queries,
+    size_t a,
+    size_t b,
+    const patolette__CellMomentsCache *cache
+) {
+/*----------------------------------------------------------------------------
+    Looks up a cell in a CellQueryCache, and returns the index of its
+    query results in queries->queries. If the cell has not been seen
+    before, its distortion is evaluated and it's inserted.
+
+    @params
+    queries - The CellQueryCache object.
+    a - The lower end of the cell.
+    b - The upper end of the cell.
+    cache - The CellMomentsCache object.
+
+    @note
+    Insertion may reallocate queries->queries, so pointers into it
+    shouldn't be kept around across calls. Indexes stay valid.
+
+    @note
+    The cell's axis and bias are not evaluated here, check
+    patolette__CELLS_evaluate_query_bias.
+-----------------------------------------------------------------------------*/
+    size_t mask = queries->table_size - 1;
+    size_t slot = hash_cell(a, b) & mask;
+
+    while (queries->table[slot] != 0) {
+        size_t index = queries->table[slot] - 1;
+        patolette__CellQuery *query = &queries->queries[index];
+        if (query->a == a && query->b == b) {
+            return index;
+        }
+        slot = (slot + 1) & mask;
     }
 
-    else {
-        double dot = (
-            patolette__Vector_index(pca->axis, 0) * patolette__Vector_index(axis, 0) +
-            patolette__Vector_index(pca->axis, 1) * patolette__Vector_index(axis, 1) +
-            patolette__Vector_index(pca->axis, 2) * patolette__Vector_index(axis, 2)
+    if (queries->length == queries->capacity) {
+        patolette__CellQuery *grown = patolette__ARENA_malloc(
+            sizeof(patolette__CellQuery) * 2 * queries->capacity
         );
 
-        double cos = dot / norms;
-        result = fmin(1, fabs(cos));
+        memcpy(grown, queries->queries, sizeof(patolette__CellQuery) * queries->length);
+        patolette__ARENA_free(queries->queries);
+        queries->queries = grown;
+        queries->capacity *= 2;
+    }
+
+    size_t index = queries->length;
+    patolette__CellQuery *query = &queries->queries[index];
+    query->a = a;
+    query->b = b;
+    query->distortion = patolette__CELLS_get_cell_distortion(a, b, cache);
+    query->bias = 0;
+    query->has_bias = false;
+
+    queries->length++;
+    queries->table[slot] = index + 1;
+
+    // Keep the load factor at or below 1/2
+    if (2 * queries->length > queries->table_size) {
+        rehash_queries(queries, 2 * queries->table_size);
+    }
+
+    return index;
+}
+
+bool patolette__CELLS_evaluate_query_bias(
+    patolette__CellQuery *query,
+    const patolette__Vector *axis,
+    const patolette__CellMomentsCache *cache
+) {
+/*----------------------------------------------------------------------------
+    Evaluates the principal axis and the bias of a cached cell query
+    (no-op if already evaluated).
+
+    @params
+    query - The cell query.
+    axis - The axis to compare to. It must be the same for every query
+    in a given CellQueryCache.
+    cache - The CellMomentsCache object.
+
+    @note
+    Returns false if PCA fails.
+
+    @note
+    Distinct queries can be evaluated concurrently.
+-----------------------------------------------------------------------------*/
+    if (query->has_bias) {
+        return true;
+    }
+
+    patolette__PCA *pca = patolette__CELLS_perform_PCA(query->a, query->b, cache);
+    if (pca == NULL) {
+        return false;
     }
 
+    query->axis[0] = patolette__Vector_index(pca->axis, 0);
+    query->axis[1] = patolette__Vector_index(pca->axis, 1);
+    query->axis[2] = patolette__Vector_index(pca->axis, 2);
+    query->bias = get_axis_bias(pca->axis, axis);
+    query->has_bias = true;
+
     patolette__PCA_destroy(pca);
-    return result;
+    return true;
 }
 
 /*----------------------------------------------------------------------------
@@ -1,20 +1,24 @@
 #include "quantize/cluster.h"
 
 /*----------------------------------------------------------------------------
-    patolette__ColorCluster
+    patolette__ClusterTable
 
     This file defines functions that work on color clusters. The actual
-    patolette__ColorClusterArray definition can be found in "quantize/cluster.h"
+    patolette__ClusterTable definition can be found in "quantize/cluster.h"
 
     The main properties of interest:
     1. Distortion (sum of squared deviations, or size-weighted variance)
     2. Principal axis
-    3. Colors
-    4. Center
-    5. Weights
+    3. Center
 
-    Should only be retrieved via their respective getters. They are all
-    computed only once and then cached.
+    They are all computed together only once (check
+    patolette__ClusterTable_compute_stats) and stored in the table.
+
+    Clusters don't own their colors. Every cluster is a range [begin, end)
+    of a single patolette__ClusterBuffer, and splitting a cluster partitions
+    its range in place, so a cluster takes constant memory regardless of
+    its size. All per-cluster properties live in flat arrays indexed by
+    node, so scans over clusters walk contiguous memory.
 
     @note
     Cluster splitting is performed in local.c
@@ -22,240 +26,541 @@
 
 
 /*----------------------------------------------------------------------------
-    Exported functions START
+    Constants START
 -----------------------------------------------------------------------------*/
 
-void patolette__ColorCluster_destroy(patolette__ColorCluster *cluster) {
+// Clusters below this size are not worth splitting across threads
+static const size_t parallel_rows = 1 << 16;
+
 /*----------------------------------------------------------------------------
-    Destroys a color cluster.
+    Constants END
+-----------------------------------------------------------------------------*/
 
-    @params
-    cluster - The cluster to destroy.
+
+/*----------------------------------------------------------------------------
+    Declarations START
 -----------------------------------------------------------------------------*/
 
-    if (cluster == NULL) {
-        return;
+static int get_thread_count(size_t size);
+
+static void sum_moments(
+    const patolette__ClusterTable *table,
+    size_t node,
+    double *sums
+);
+
+static void sum_centered_moments(
+    const patolette__ClusterTable *table,
+    size_t node,
+    const double *center,
+    double *sums
+);
+
+/*----------------------------------------------------------------------------
+    Declarations END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+    Internal functions START
+-----------------------------------------------------------------------------*/
+
+static int get_thread_count(size_t size) {
+/*----------------------------------------------------------------------------
+    Gets the number of threads passes over a color cluster's range
+    should be split across.
+
+    @params
+    size - The size of the color cluster.
+-----------------------------------------------------------------------------*/
+    if (size < parallel_rows) {
+        return 1;
     }
 
-    patolette__Vector_destroy(cluster->_center);
-    patolette__Vector_destroy(cluster->_principal_axis);
-    patolette__Vector_destroy(cluster->weights);
-    patolette__Matrix2D_destroy(cluster->_colors);
-    patolette__IndexArray_destroy(cluster->indices);
-    free(cluster);
+    return omp_get_max_threads();
 }
 
-patolette__ColorCluster *patolette__ColorCluster_init(
-    const patolette__Matrix2D *dataset,
-    const patolette__Vector *dataset_weights,
-    patolette__IndexArray *indices
+static void sum_moments(
+    const patolette__ClusterTable *table,
+    size_t node,
+    double *sums
 ) {
 /*----------------------------------------------------------------------------
-    Initializes a color cluster.
+    Sums the (weighted) colors of a color cluster, as well as their
+    weights and scatter.
 
     @params
-    dataset - The color dataset the cluster belongs to.
-    dataset_weights - Weight of each sample in the dataset.
-    indices - The indices of the cluster's colors in the color dataset.
+    table - The cluster table.
+    node - The cluster.
+    sums - On exit, [sum(w * x), sum(w * y), sum(w * z), sum(w), sum(scatter)].
+
+    @note
+    Each thread sums into its own partial sums, which are reduced in
+    thread order afterwards, so results are deterministic for a given
+    thread count.
 -----------------------------------------------------------------------------*/
-    patolette__ColorCluster *cluster = malloc(sizeof *cluster);
-
-    // All these properties start undefined.
-    // They're only computed when first requested via
-    // their getters, and cached for later use.
-    cluster->_distortion = -1.0;
-    cluster->_principal_axis = NULL;
-    cluster->_colors = NULL;
-    cluster->_center = NULL;
-
-    cluster->size = indices->length;
-    cluster->indices = indices;
-    cluster->weights = NULL;
-    cluster->dataset__NOTOWNED__ = dataset;
-
-    cluster->dataset_weights__NOTOWNED__ = dataset_weights;
-    return cluster;
+    const patolette__ClusterBuffer *buffer = table->buffer;
+    const patolette__Matrix2D *colors = buffer->colors;
+    const patolette__FloatArray *weights = buffer->weights;
+    const patolette__Vector *scatter = buffer->scatter;
+
+    size_t begin = patolette__IndexArray_index(table->begin, node);
+    size_t end = patolette__IndexArray_index(table->end, node);
+
+    const double *cx = &patolette__Matrix2D_index(colors, 0, 0);
+    const double *cy = &patolette__Matrix2D_index(colors, 0, 1);
+    const double *cz = &patolette__Matrix2D_index(colors, 0, 2);
+
+    int thread_count = get_thread_count(end - begin);
+    double *partials = patolette__ARENA_calloc((size_t)thread_count * 5, sizeof(double));
+
+    #pragma omp parallel num_threads(thread_count) if (thread_count > 1)
+    {
+        double sx = 0;
+        double sy = 0;
+        double sz = 0;
+        double w_sum = 0;
+        double s_sum = 0;
+
+        #pragma omp for schedule(static)
+        for (size_t i = begin; i < end; i++) {
+            double weight = weights == NULL ? 1 : patolette__FloatArray_index(weights, i);
+            sx += cx[i] * weight;
+            sy += cy[i] * weight;
+            sz += cz[i] * weight;
+            w_sum += weight;
+            s_sum += scatter == NULL ? 0 : patolette__Vector_index(scatter, i);
+        }
+
+        double *partial = &partials[5 * omp_get_thread_num()];
+        partial[0] = sx;
+        partial[1] = sy;
+        partial[2] = sz;
+        partial[3] = w_sum;
+        partial[4] = s_sum;
+    }
+
+    for (size_t k = 0; k < 5; k++) {
+        sums[k] = 0;
+    }
+
+    for (int t = 0; t < thread_count; t++) {
+        for (size_t k = 0; k < 5; k++) {
+            sums[k] += partials[5 * t + k];
+        }
+    }
+
+    patolette__ARENA_free(partials);
 }
 
-const patolette__Vector *patolette__ColorCluster_get_weights(patolette__ColorCluster *cluster) {
+static void sum_centered_moments(
+    const patolette__ClusterTable *table,
+    size_t node,
+    const double *center,
+    double *sums
+) {
 /*----------------------------------------------------------------------------
-    Gets the weight of each one of the color cluster's colors.
+    Sums the (weighted) centered second moments of a color cluster.
 
     @params
-    cluster - The color cluster.
+    table - The cluster table.
+    node - The cluster.
+    center - The cluster's center.
+    sums - On exit, the distortion followed by the xx, xy, xz, yy, yz
+    and zz moments.
+
+    @note
+    Reduced the same way as in sum_moments.
 -----------------------------------------------------------------------------*/
-    const patolette__Vector *dataset_weights = cluster->dataset_weights__NOTOWNED__;
-    if (dataset_weights == NULL) {
-        return NULL;
+    const patolette__ClusterBuffer *buffer = table->buffer;
+    const patolette__Matrix2D *colors = buffer->colors;
+    const patolette__FloatArray *weights = buffer->weights;
+
+    size_t begin = patolette__IndexArray_index(table->begin, node);
+    size_t end = patolette__IndexArray_index(table->end, node);
+
+    const double *cx = &patolette__Matrix2D_index(colors, 0, 0);
+    const double *cy = &patolette__Matrix2D_index(colors, 0, 1);
+    const double *cz = &patolette__Matrix2D_index(colors, 0, 2);
+
+    double x = center[0];
+    double y = center[1];
+    double z = center[2];
+
+    int thread_count = get_thread_count(end - begin);
+    double *partials = patolette__ARENA_calloc((size_t)thread_count * 7, sizeof(double));
+
+    #pragma omp parallel num_threads(thread_count) if (thread_count > 1)
+    {
+        double distortion = 0;
+        double xx = 0, xy = 0, xz = 0;
+        double yy = 0, yz = 0, zz = 0;
+
+        #pragma omp for schedule(static)
+        for (size_t i = begin; i < end; i++) {
+            double weight = weights == NULL ? 1 : patolette__FloatArray_index(weights, i);
+            double dx = cx[i] - x;
+            double dy = cy[i] - y;
+            double dz = cz[i] - z;
+
+            distortion += (SQ(dx) + SQ(dy) + SQ(dz)) * weight;
+
+            xx += weight * dx * dx;
+            xy += weight * dx * dy;
+            xz += weight * dx * dz;
+            yy += weight * dy * dy;
+            yz += weight * dy * dz;
+            zz += weight * dz * dz;
+        }
+
+        double *partial = &partials[7 * omp_get_thread_num()];
+        partial[0] = distortion;
+        partial[1] = xx;
+        partial[2] = xy;
+        partial[3] = xz;
+        partial[4] = yy;
+        partial[5] = yz;
+        partial[6] = zz;
     }
 
-    patolette__Vector *weights = cluster->weights;
-
-    if (weights != NULL) {
-        // Weights are cached
-        return weights;
+    for (size_t k = 0; k < 7; k++) {
+        sums[k] = 0;
     }
 
-    weights = patolette__Vector_init(cluster->size);
-
-    const patolette__IndexArray *indices = cluster->indices;
-    for (size_t i = 0; i < indices->length; i++) {
-        size_t index = patolette__IndexArray_index(indices, i);
-        patolette__Vector_index(weights, i) = patolette__Vector_index(dataset_weights, index);
+    for (int t = 0; t < thread_count; t++) {
+        for (size_t k = 0; k < 7; k++) {
+            sums[k] += partials[7 * t + k];
+        }
     }
 
-    cluster->weights = weights;
-    return weights;
+    patolette__ARENA_free(partials);
 }
 
-double patolette__ColorCluster_get_distortion(patolette__ColorCluster *cluster) {
 /*----------------------------------------------------------------------------
-    Gets a color cluster's distortion.
+    Internal functions END
+-----------------------------------------------------------------------------*/
 
-    @params
-    cluster - The color cluster.
+
+/*----------------------------------------------------------------------------
+    Exported functions START
 -----------------------------------------------------------------------------*/
-    double distortion = cluster->_distortion;
 
-    if (distortion != -1.0) {
-        // Distortion is cached
-        return distortion;
-    }
+void patolette__ClusterBuffer_destroy(patolette__ClusterBuffer *buffer) {
+/*----------------------------------------------------------------------------
+    Destroys a cluster buffer.
 
-    const patolette__Matrix2D *colors = patolette__ColorCluster_get_colors(cluster);
-    const patolette__Vector *weights = patolette__ColorCluster_get_weights(cluster);
-
-    const patolette__Vector *center = patolette__ColorCluster_get_center(cluster);
-    double x = patolette__Vector_index(center, 0);
-    double y = patolette__Vector_index(center, 1);
-    double z = patolette__Vector_index(center, 2);
-
-    distortion = 0;
-    size_t size = cluster->size;
-    for (size_t i = 0; i < size; i++) {
-        double weight = weights == NULL ? 1 : patolette__Vector_index(weights, i);
-        double cx = patolette__Matrix2D_index(colors, i, 0);
-        double cy = patolette__Matrix2D_index(colors, i, 1);
-        double cz = patolette__Matrix2D_index(colors, i, 2);
-
-        double distance = (
-          SQ(cx - x) +
-          SQ(cy - y) +
-          SQ(cz - z)
-        ) * weight;
-
-        distortion += distance;
+    @params
+    buffer - The buffer to destroy.
+-----------------------------------------------------------------------------*/
+    if (buffer == NULL) {
+        return;
     }
 
-    cluster->_distortion = distortion;
-    return distortion;
+    patolette__Matrix2D_destroy(buffer->colors);
+    patolette__FloatArray_destroy(buffer->weights);
+    patolette__Vector_destroy(buffer->scatter);
+    patolette__UInt16Array_destroy(buffer->buckets);
+    patolette__ARENA_free(buffer);
 }
 
-double patolette__ColorCluster_get_variance(patolette__ColorCluster *cluster) {
+patolette__ClusterBuffer *patolette__ClusterBuffer_init(
+    size_t size,
+    bool weighted,
+    bool scattered
+) {
 /*----------------------------------------------------------------------------
-    Gets a color cluster's variance.
+    Initializes a (zeroed) cluster buffer.
 
     @params
-    cluster - The color cluster.
+    size - The number of colors in the buffer.
+    weighted - Whether colors are weighted.
+    scattered - Whether colors carry scatter.
 -----------------------------------------------------------------------------*/
-    size_t size = cluster->size;
+    patolette__ClusterBuffer *buffer = patolette__ARENA_malloc(sizeof *buffer);
+    buffer->colors = patolette__Matrix2D_init(size, 3, NULL);
+    buffer->weights = weighted ? patolette__FloatArray_init(size) : NULL;
+    buffer->scatter = scattered ? patolette__Vector_init(size) : NULL;
+    buffer->buckets = patolette__UInt16Array_init(size);
+    return buffer;
+}
 
-    if (size == 0) {
-        return 0;
+void patolette__ClusterTable_destroy(patolette__ClusterTable *table) {
+/*----------------------------------------------------------------------------
+    Destroys a cluster table, along with its buffer.
+
+    @params
+    table - The table to destroy.
+-----------------------------------------------------------------------------*/
+    if (table == NULL) {
+        return;
     }
 
-    double distortion = patolette__ColorCluster_get_distortion(cluster);
-    return distortion / (double)size;
+    patolette__IndexArray_destroy(table->begin);
+    patolette__IndexArray_destroy(table->end);
+    patolette__Vector_destroy(table->weight);
+    patolette__Matrix2D_destroy(table->center);
+    patolette__Matrix2D_destroy(table->axis);
+    patolette__Vector_destroy(table->distortion);
+    patolette__BoolArray_destroy(table->has_stats);
+    patolette__BoolArray_destroy(table->has_axis);
+    patolette__IndexArray_destroy(table->parent);
+    patolette__IndexArray_destroy(table->left);
+    patolette__IndexArray_destroy(table->right);
+    patolette__IndexArray_destroy(table->live);
+    patolette__IndexArray_destroy(table->split_nodes);
+    patolette__IndexArray_destroy(table->split_slots);
+    patolette__ClusterBuffer_destroy(table->buffer);
+    patolette__ARENA_free(table);
 }
 
-const patolette__Vector *patolette__ColorCluster_get_center(patolette__ColorCluster *cluster) {
+patolette__ClusterTable *patolette__ClusterTable_init(
+    patolette__ClusterBuffer *buffer,
+    size_t capacity
+) {
 /*----------------------------------------------------------------------------
-    Gets a color cluster's center (mean).
+    Initializes an empty cluster table. All arrays are allocated once,
+    for the maximum number of nodes.
 
     @params
-    cluster - The color cluster.
+    buffer - The buffer the clusters are ranges of. The table takes
+    ownership of it.
+    capacity - The maximum number of nodes.
 -----------------------------------------------------------------------------*/
-    patolette__Vector *center = cluster->_center;
+    patolette__ClusterTable *table = patolette__ARENA_malloc(sizeof *table);
+    table->begin = patolette__IndexArray_init(capacity);
+    table->end = patolette__IndexArray_init(capacity);
+    table->weight = patolette__Vector_init(capacity);
+    table->center = patolette__Matrix2D_init(capacity, 3, NULL);
+    table->axis = patolette__Matrix2D_init(capacity, 3, NULL);
+    table->distortion = patolette__Vector_init(capacity);
+    table->has_stats = patolette__BoolArray_init(capacity);
+    table->has_axis = patolette__BoolArray_init(capacity);
+    table->parent = patolette__IndexArray_init(capacity);
+    table->left = patolette__IndexArray_init(capacity);
+    table->right = patolette__IndexArray_init(capacity);
+    table->live = patolette__IndexArray_init(capacity);
+    table->split_nodes = patolette__IndexArray_init(capacity);
+    table->split_slots = patolette__IndexArray_init(capacity);
+    table->split_count = 0;
+    table->count = 0;
+    table->capacity = capacity;
+    table->length = 0;
+    table->buffer = buffer;
+    return table;
+}
 
-    if (center != NULL) {
-        return center;
-    }
+size_t patolette__ClusterTable_reserve(patolette__ClusterTable *table, size_t count) {
+/*----------------------------------------------------------------------------
+    Reserves a run of consecutive nodes, and returns the first one.
+    Reserved nodes must be filled in via patolette__ClusterTable_set.
 
-    const patolette__Matrix2D *colors = patolette__ColorCluster_get_colors(cluster);
-    const patolette__Vector *weights = patolette__ColorCluster_get_weights(cluster);
-    center = patolette__Matrix2D_get_vector_mean(colors, weights);
-    cluster->_center = center;
-    return center;
+    @params
+    table - The cluster table.
+    count - The number of nodes to reserve.
+
+    @note
+    Reserving ahead of time lets concurrent splits fill in their own
+    nodes without any synchronization.
+-----------------------------------------------------------------------------*/
+    size_t first = table->count;
+    table->count += count;
+    return first;
 }
 
-const patolette__Vector *patolette__ColorCluster_get_principal_axis(patolette__ColorCluster *cluster) {
+void patolette__ClusterTable_set(
+    patolette__ClusterTable *table,
+    size_t node,
+    size_t begin,
+    size_t end,
+    size_t parent
+) {
 /*----------------------------------------------------------------------------
-    Gets a color cluster's principal axis.
+    Fills in a (reserved) node. Its properties start undefined.
 
     @params
-    cluster - The color cluster.
+    table - The cluster table.
+    node - The node.
+    begin - The start of the cluster's range in the buffer.
+    end - The end (exclusive) of the cluster's range in the buffer.
+    parent - The node the cluster was split from, or patolette__CLUSTER_NONE.
 -----------------------------------------------------------------------------*/
-    patolette__Vector *axis = cluster->_principal_axis;
+    patolette__IndexArray_index(table->begin, node) = begin;
+    patolette__IndexArray_index(table->end, node) = end;
+    patolette__IndexArray_index(table->parent, node) = parent;
+    patolette__IndexArray_index(table->left, node) = patolette__CLUSTER_NONE;
+    patolette__IndexArray_index(table->right, node) = patolette__CLUSTER_NONE;
+    patolette__BoolArray_index(table->has_stats, node) = false;
+    patolette__BoolArray_index(table->has_axis, node) = false;
+}
 
-    if (axis != NULL) {
-        // Cluster's principal axis is cached
-        return axis;
+void patolette__ClusterTable_compute_stats(patolette__ClusterTable *table, size_t node) {
+/*----------------------------------------------------------------------------
+    Computes a color cluster's center, weight, distortion and principal
+    axis, and stores them in the table. Does nothing if they are already
+    computed.
+
+    @params
+    table - The cluster table.
+    node - The cluster.
+
+    @note
+    This takes two streaming passes over the cluster's range: one for the
+    (weighted) mean, and one for the centered second moments. The
+    distortion is the trace of the unnormalized variance-covariance matrix,
+    which is then handed over to PCA.
+-----------------------------------------------------------------------------*/
+    if (patolette__BoolArray_index(table->has_stats, node)) {
+        return;
     }
 
-    const patolette__Matrix2D *colors = patolette__ColorCluster_get_colors(cluster);
-    const patolette__Vector *weights = patolette__ColorCluster_get_weights(cluster);
+    patolette__BoolArray_index(table->has_stats, node) = true;
+
+    // Mean
+    double moments[5];
+    sum_moments(table, node, moments);
+
+    double w_sum = moments[3];
+    double s = 1 / w_sum;
+    double center[3] = {
+        moments[0] * s,
+        moments[1] * s,
+        moments[2] * s
+    };
+
+    patolette__Vector_index(table->weight, node) = w_sum;
+    for (size_t j = 0; j < 3; j++) {
+        patolette__Matrix2D_index(table->center, node, j) = center[j];
+    }
 
-    patolette__PCA *pca = patolette__PCA_perform_PCA(colors, weights);
+    // Centered second moments
+    double centered[7];
+    sum_centered_moments(table, node, center, centered);
+    // Colors standing for several ones add their own scatter, so the
+    // distortion is that of the colors they stand for.
+    patolette__Vector_index(table->distortion, node) = centered[0] + moments[4];
+
+    if (patolette__ClusterTable_size(table, node) <= 1) {
+        // Principal axis is meaningless
+        return;
+    }
+
+    // Scatter only has a trace (no direction), so the principal axis is
+    // that of the colors themselves, e.g. of the bin means.
+    double xx = centered[1], xy = centered[2], xz = centered[3];
+    double yy = centered[4], yz = centered[5], zz = centered[6];
+
+    patolette__Matrix2D *vcov = patolette__Matrix2D_init(3, 3, NULL);
+    patolette__Matrix2D_index(vcov, 0, 0) = xx / w_sum;
+    patolette__Matrix2D_index(vcov, 0, 1) = xy / w_sum;
+    patolette__Matrix2D_index(vcov, 0, 2) = xz / w_sum;
+    patolette__Matrix2D_index(vcov, 1, 0) = xy / w_sum;
+    patolette__Matrix2D_index(vcov, 1, 1) = yy / w_sum;
+    patolette__Matrix2D_index(vcov, 1, 2) = yz / w_sum;
+    patolette__Matrix2D_index(vcov, 2, 0) = xz / w_sum;
+    patolette__Matrix2D_index(vcov, 2, 1) = yz / w_sum;
+    patolette__Matrix2D_index(vcov, 2, 2) = zz / w_sum;
+
+    patolette__PCA *pca = patolette__PCA_perform_PCA_vcov(vcov);
     if (pca != NULL) {
-        axis = patolette__Vector_init(pca->axis->length);
-        patolette__Vector_copy_into(pca->axis, axis);
-        cluster->_principal_axis = axis;
+        for (size_t j = 0; j < 3; j++) {
+            patolette__Matrix2D_index(table->axis, node, j) = patolette__Vector_index(pca->axis, j);
+        }
+        patolette__BoolArray_index(table->has_axis, node) = true;
+        patolette__PCA_destroy(pca);
     }
 
-    patolette__PCA_destroy(pca);
-    return axis;
+    patolette__Matrix2D_destroy(vcov);
 }
 
-const patolette__Matrix2D *patolette__ColorCluster_get_colors(patolette__ColorCluster *cluster) {
+double patolette__ClusterTable_get_distortion(patolette__ClusterTable *table, size_t node) {
 /*----------------------------------------------------------------------------
-    Gets a color cluster's colors.
+    Gets a color cluster's distortion.
 
     @params
-    cluster - The color cluster.
+    table - The cluster table.
+    node - The cluster.
 -----------------------------------------------------------------------------*/
-    patolette__Matrix2D *colors = cluster->_colors;
-
-    if (colors != NULL) {
-        // Cluster colors are cached
-        return colors;
-    }
-
-    const patolette__Matrix2D  *dataset = cluster->dataset__NOTOWNED__;
-    const patolette__IndexArray *indices = cluster->indices;
-    colors = patolette__Matrix2D_extract_rows(dataset, indices);
-    cluster->_colors = colors;
-    return colors;
+    patolette__ClusterTable_compute_stats(table, node);
+    return patolette__Vector_index(table->distortion, node);
 }
 
-// TODO: refactor, weird placement
-void patolette__ColorClusterArray_destroy_deep(patolette__ColorClusterArray *array) {
+size_t patolette__ClusterTable_partition(
+    patolette__ClusterTable *table,
+    size_t node,
+    size_t split_bucket
+) {
 /*----------------------------------------------------------------------------
-    Destroys a color cluster array, as well as each color cluster
-    found in it.
+    Partitions a color cluster's range in place, quicksort style, so that
+    colors whose bucket is <= split_bucket come first. Returns the
+    position in the buffer where the second part starts.
 
     @params
-    array - The color cluster array.
+    table - The cluster table.
+    node - The cluster.
+    split_bucket - The last bucket of the first part.
+
+    @note
+    Bucket ids are read from the buffer's scratch space, so they must have
+    been written for the cluster's range beforehand. They are not swapped
+    along with the colors, and are meaningless afterwards.
+
+    @note
+    The cluster's properties are computed before partitioning, as they
+    don't depend on the order of its colors.
 -----------------------------------------------------------------------------*/
-    for (size_t i = 0; i < array->length; i++) {
-        patolette__ColorCluster *cluster = patolette__ColorClusterArray_index(
-            array,
-            i
-        );
-        patolette__ColorCluster_destroy(cluster);
+    patolette__ClusterTable_compute_stats(table, node);
+
+    patolette__ClusterBuffer *buffer = table->buffer;
+    patolette__Matrix2D *colors = buffer->colors;
+    patolette__FloatArray *weights = buffer->weights;
+    patolette__Vector *scatter = buffer->scatter;
+    const uint16_t *buckets = buffer->buckets->data;
+
+    double *cx = &patolette__Matrix2D_index(colors, 0, 0);
+    double *cy = &patolette__Matrix2D_index(colors, 0, 1);
+    double *cz = &patolette__Matrix2D_index(colors, 0, 2);
+
+    size_t low = patolette__IndexArray_index(table->begin, node);
+    size_t high = patolette__IndexArray_index(table->end, node);
+
+    while (true) {
+        while (low < high && buckets[low] <= split_bucket) {
+            low++;
+        }
+
+        while (low < high && buckets[high - 1] > split_bucket) {
+            high--;
+        }
+
+        if (low >= high) {
+            break;
+        }
+
+        size_t j = high - 1;
+        double t;
+        t = cx[low]; cx[low] = cx[j]; cx[j] = t;
+        t = cy[low]; cy[low] = cy[j]; cy[j] = t;
+        t = cz[low]; cz[low] = cz[j]; cz[j] = t;
+
+        if (weights != NULL) {
+            float w = patolette__FloatArray_index(weights, low);
+            patolette__FloatArray_index(weights, low) = patolette__FloatArray_index(weights, j);
+            patolette__FloatArray_index(weights, j) = w;
+        }
+
+        if (scatter != NULL) {
+            t = patolette__Vector_index(scatter, low);
+            patolette__Vector_index(scatter, low) = patolette__Vector_index(scatter, j);
+            patolette__Vector_index(scatter, j) = t;
+        }
+
+        low++;
+        high--;
     }
-    patolette__ColorClusterArray_destroy(array);
+
+    return low;
 }
 
 /*----------------------------------------------------------------------------
-    Exported functions START
------------------------------------------------------------------------------*/
\ No newline at end of file
+    Exported functions END
+-----------------------------------------------------------------------------*/
@@ -36,11 +36,13 @@ static patolette__IndexArray *l_chain(
     size_t N
 );
 
-static patolette__ColorClusterArray *get_color_clusters(
+static patolette__ClusterTable *get_color_clusters(
     const patolette__Matrix2D *colors,
-    const patolette__Vector *weights,
+    const patolette__Weights *weights,
+    const patolette__Vector *scatter,
     const patolette__IndexArray *quantizer,
-    const patolette__IndexArray *bucket_map
+    const patolette__UInt16Array *bucket_map,
+    size_t palette_size
 );
 
 static patolette__IndexArray *get_principal_quantizer(
@@ -52,6 +54,7 @@ static bool should_terminate(
     patolette__IndexArray *quantizer,
     patolette__Vector *axis,
     const patolette__CellMomentsCache *cache,
+    patolette__CellQueryCache *queries,
     bool *error
 );
 
@@ -100,6 +103,7 @@ static bool should_terminate(
     patolette__IndexArray *quantizer,
     patolette__Vector *axis,
     const patolette__CellMomentsCache *cache,
+    patolette__CellQueryCache *queries,
     bool *error
 ) {
 /*----------------------------------------------------------------------------
@@ -134,55 +138,64 @@ static bool should_terminate(
    quantizer - The global principal quantizer.
    axis - The principal axis of the color set.
    cache - The CellMomentsCache object.
+   queries - Memoized cell query results.
    error - A flag that is set to true if there's an error.
+
+   @note
+   Most cells of Q(k) were already cells of Q(k - 1) (or earlier), so cell
+   query results are memoized. Biases of new cells are independent of each
+   other, so they are evaluated in a parallel batch, and only then reduced.
 -----------------------------------------------------------------------------*/
-    double distortion = 0;
+    size_t count = quantizer->length - 1;
+    patolette__IndexArray *indexes = patolette__IndexArray_init(count);
 
-    for (size_t j = 0; j < quantizer->length - 1; j++) {
+    // Lookups are done serially, as they may insert into the cache
+    double distortion = 0;
+    for (size_t j = 0; j < count; j++) {
         size_t low = patolette__IndexArray_index(quantizer, j);
         size_t high = patolette__IndexArray_index(quantizer, j + 1);
 
-        distortion += patolette__CELLS_get_cell_distortion(
-            low,
-            high,
-            cache
-        );
+        size_t index = patolette__CellQueryCache_get(queries, low, high, cache);
+        patolette__IndexArray_index(indexes, j) = index;
+        distortion += queries->queries[index].distortion;
     }
 
     if (distortion < patolette__DELTA) {
+        patolette__IndexArray_destroy(indexes);
         return true;
     }
 
-    double bias = 0;
-    for (size_t i = 0; i < quantizer->length - 1 ; i++) {
-        size_t low = patolette__IndexArray_index(quantizer, i);
-        size_t high = patolette__IndexArray_index(quantizer, i + 1);
-
-        double cell_distortion = patolette__CELLS_get_cell_distortion(
-            low,
-            high,
-            cache
-        );
+    bool failed = false;
 
-        double cell_bias = patolette__CELLS_get_cell_bias(
-            low,
-            high,
-            axis,
-            cache
-        );
+    #pragma omp parallel for schedule(dynamic) reduction(||:failed)
+    for (size_t j = 0; j < count; j++) {
+        size_t index = patolette__IndexArray_index(indexes, j);
+        patolette__CellQuery *query = &queries->queries[index];
 
-        if (cell_bias < 0) {
-            *error = true;
-            return true;
+        if (!patolette__CELLS_evaluate_query_bias(query, axis, cache)) {
+            failed = true;
         }
+    }
+
+    if (failed) {
+        patolette__IndexArray_destroy(indexes);
+        *error = true;
+        return true;
+    }
+
+    double bias = 0;
+    for (size_t j = 0; j < count; j++) {
+        size_t index = patolette__IndexArray_index(indexes, j);
+        const patolette__CellQuery *query = &queries->queries[index];
 
-        if (cell_bias < cell_bias_threshold) {
+        if (query->bias < cell_bias_threshold) {
             continue;
         }
 
-        bias += (cell_distortion / distortion) * cell_bias;
+        bias += (query->distortion / distortion) * query->bias;
     }
 
+    patolette__IndexArray_destroy(indexes);
     return bias < bias_threshold;
 }
 
@@ -241,12 +254,18 @@ static patolette__IndexArray *get_principal_quantizer(
 
     patolette__IndexArray *result = l_chain(L, 1, N);
 
+    // Lives for the whole call; Q(k) has k cells
+    patolette__CellQueryCache *queries = patolette__CellQueryCache_init(
+        max_k * (max_k + 1) / 2
+    );
+
     for (size_t k = 2; k <= min(max_k, palette_size); k++) {
         if (
             should_terminate(
                 result,
                 pca->axis,
                 cache,
+                queries,
                 &error
             )
         ) {
@@ -266,7 +285,12 @@ static patolette__IndexArray *get_principal_quantizer(
             but that doesn't account for early termination. Here,
             the full Q(k, N) quantizer is built at each k iteration
             instead, so n goes all the way up to N.
+
+            Each E[n] and L[k][n] only depends on the previous row (E__),
+            so the n loop is run in parallel. The work per iteration grows
+            with n, hence the dynamic schedule.
         -----------------------------------------------------------------------------*/
+        #pragma omp parallel for schedule(dynamic, 16)
         for (size_t n = k + 1; n <= N; n++) {
             double cut = (double)(n - 1);
             double e = patolette__Vector_index(E__, n - 1);
@@ -291,89 +315,122 @@ static patolette__IndexArray *get_principal_quantizer(
     }
 
     patolette__PCA_destroy(pca);
+    patolette__CellQueryCache_destroy(queries);
     patolette__Vector_destroy(E);
     patolette__Vector_destroy(E__);
     patolette__Matrix2D_destroy(L);
     return result;
 }
 
-static patolette__ColorClusterArray *get_color_clusters(
+static patolette__ClusterTable *get_color_clusters(
     const patolette__Matrix2D *colors,
-    const patolette__Vector *weights,
+    const patolette__Weights *weights,
+    const patolette__Vector *scatter,
     const patolette__IndexArray *quantizer,
-    const patolette__IndexArray *bucket_map
+    const patolette__UInt16Array *bucket_map,
+    size_t palette_size
 ) {
 /*----------------------------------------------------------------------------
    Builds color clusters from the principal quantizer.
 
    @params
    colors - The color set.
+   weights - Weight of each color in the color set.
+   scatter - Scatter of each color in the color set, or NULL.
    quantizer - The computed global principal quantizer.
    bucket_map - Describes a bucket sorting of the colors based on their
    individual projections onto the color set's principal axis.
+   palette_size - The desired palette size, used to size the table for
+   the local stage.
+
+   @note
+   The colors (and weights, and scatter) are scattered into the buffer with a counting
+   sort on their cluster, so each cluster ends up being a contiguous range.
+   Colors keep their relative order within a cluster.
 -----------------------------------------------------------------------------*/
     size_t count = quantizer->length - 1;
-
-    // Size of each cluster
-    patolette__IndexArray *sizes = patolette__IndexArray_init(count);
-
-    // The bucket -> cluster relationship can be cached
-    patolette__BoolArray *cache_set = patolette__BoolArray_init(bucket_count);
-    patolette__IndexArray *cache = patolette__IndexArray_init(bucket_count);
-
-    for (size_t i = 0; i < bucket_map->length; i++) {
-        size_t bucket = patolette__IndexArray_index(bucket_map, i);
-
-        if (!patolette__BoolArray_index(cache_set, bucket)) {
-            for (size_t j = 0; j < count; j++) {
-                // Quantizer entries use 1-based indexing for buckets, thus bucket + 1
-                if (bucket + 1 <= patolette__IndexArray_index(quantizer, j + 1)) {
-                    patolette__IndexArray_index(cache, bucket) = j;
-                    patolette__BoolArray_index(cache_set, bucket) = true;
-                    break;
-                }
-            }
+    size_t rows = colors->rows;
+
+    // The bucket -> cluster relationship
+    patolette__IndexArray *cluster_of = patolette__IndexArray_init(bucket_count);
+    for (size_t bucket = 0, j = 0; bucket < bucket_count; bucket++) {
+        // Quantizer entries use 1-based indexing for buckets, thus bucket + 1
+        while (bucket + 1 > patolette__IndexArray_index(quantizer, j + 1)) {
+            j++;
         }
+        patolette__IndexArray_index(cluster_of, bucket) = j;
+    }
 
-        size_t k = patolette__IndexArray_index(cache, bucket);
-        patolette__IndexArray_index(sizes, k) += 1;
+    // Start of each cluster's range in the buffer
+    patolette__IndexArray *offsets = patolette__IndexArray_init(count + 1);
+    for (size_t i = 0; i < rows; i++) {
+        size_t bucket = patolette__UInt16Array_index(bucket_map, i);
+        size_t k = patolette__IndexArray_index(cluster_of, bucket);
+        patolette__IndexArray_index(offsets, k + 1) += 1;
     }
 
-    // The indices of each cluster's colors in the color data set
-    patolette__IndexMatrix2D *clusters_indices = patolette__IndexMatrix2D_init(count);
-    for (size_t i = 0; i < count; i++) {
-        size_t size = patolette__IndexArray_index(sizes, i);
-        patolette__IndexMatrix2D_index(clusters_indices, i) = patolette__IndexArray_init(size);
+    for (size_t k = 1; k <= count; k++) {
+        patolette__IndexArray_index(offsets, k) += patolette__IndexArray_index(offsets, k - 1);
     }
 
-    // Indices arrays are filled incrementally; we store a pivot
+    patolette__ClusterBuffer *result_buffer = patolette__ClusterBuffer_init(
+        rows,
+        weights != NULL,
+        scatter != NULL
+    );
+
+    patolette__Matrix2D *buffer_colors = result_buffer->colors;
+    patolette__FloatArray *buffer_weights = result_buffer->weights;
+    patolette__Vector *buffer_scatter = result_buffer->scatter;
+
+    // Buffer ranges are filled incrementally; we store a pivot
     // for each one of them.
-    patolette__IndexArray *pivots = patolette__IndexArray_init(count);
-    for (size_t i = 0; i < bucket_map->length; i++) {
-        size_t bucket = patolette__IndexArray_index(bucket_map, i);
-        size_t j = patolette__IndexArray_index(cache, bucket);
-        patolette__IndexArray *indices = patolette__IndexMatrix2D_index(clusters_indices, j);
-        patolette__IndexArray_index(indices, patolette__IndexArray_index(pivots, j)) = i;
-        patolette__IndexArray_index(pivots, j) += 1;
+    patolette__IndexArray *pivots = patolette__IndexArray_init(count + 1);
+    patolette__Array_copy_into(offsets, pivots);
+
+    for (size_t i = 0; i < rows; i++) {
+        size_t bucket = patolette__UInt16Array_index(bucket_map, i);
+        size_t k = patolette__IndexArray_index(cluster_of, bucket);
+        size_t p = patolette__IndexArray_index(pivots, k);
+
+        patolette__Matrix2D_index(buffer_colors, p, 0) = patolette__Matrix2D_index(colors, i, 0);
+        patolette__Matrix2D_index(buffer_colors, p, 1) = patolette__Matrix2D_index(colors, i, 1);
+        patolette__Matrix2D_index(buffer_colors, p, 2) = patolette__Matrix2D_index(colors, i, 2);
+
+        if (weights != NULL) {
+            patolette__FloatArray_index(buffer_weights, p) = (float)patolette__Weights_get(weights, i);
+        }
+
+        if (scatter != NULL) {
+            patolette__Vector_index(buffer_scatter, p) = patolette__Vector_index(scatter, i);
+        }
+
+        patolette__IndexArray_index(pivots, k) = p + 1;
     }
 
-    // Build array of clusters
-    patolette__ColorClusterArray *clusters = patolette__ColorClusterArray_init(count);
-    for (size_t i = 0; i < count; i++) {
-        patolette__IndexArray *indices = patolette__IndexMatrix2D_index(clusters_indices, i);
-        patolette__ColorClusterArray_index(clusters, i) = patolette__ColorCluster_init(
-            colors,
-            weights,
-            indices
+    // Build table of clusters. Splitting K clusters into N takes
+    // 4N - K nodes, see patolette__LQ_quantize.
+    size_t capacity = count >= palette_size ? count : 4 * palette_size - count;
+    patolette__ClusterTable *table = patolette__ClusterTable_init(result_buffer, capacity);
+
+    size_t first = patolette__ClusterTable_reserve(table, count);
+    for (size_t k = 0; k < count; k++) {
+        patolette__ClusterTable_set(
+            table,
+            first + k,
+            patolette__IndexArray_index(offsets, k),
+            patolette__IndexArray_index(offsets, k + 1),
+            patolette__CLUSTER_NONE
         );
+        patolette__ClusterTable_live(table, k) = first + k;
     }
+    table->length = count;
 
-    patolette__IndexArray_destroy(sizes);
-    patolette__BoolArray_destroy(cache_set);
-    patolette__IndexArray_destroy(cache);
-    patolette__IndexMatrix2D_destroy(clusters_indices);
+    patolette__IndexArray_destroy(cluster_of);
+    patolette__IndexArray_destroy(offsets);
     patolette__IndexArray_destroy(pivots);
-    return clusters;
+
+    return table;
 }
 
 /*----------------------------------------------------------------------------
@@ -385,9 +442,11 @@ static patolette__ColorClusterArray *get_color_clusters(
    Exported functions START
 -----------------------------------------------------------------------------*/
 
-patolette__ColorClusterArray *patolette__GQ_quantize(
+patolette__ClusterTable *patolette__GQ_quantize(
     const patolette__Matrix2D *colors,
-    const patolette__Vector *weights,
+    const patolette__Weights *weights,
+    const patolette__Vector *scatter,
+    bool weighted,
     size_t palette_size
 ) {
 /*----------------------------------------------------------------------------
@@ -396,29 +455,42 @@ patolette__ColorClusterArray *patolette__GQ_quantize(
     @params
     colors - The color set.
     weights - Weight of each color in the color set.
+    scatter - The (weighted) scatter of the colors each color stands for,
+    e.g. when colors are histogram bins, or NULL.
+    weighted - Whether this stage weighs colors too, i.e. whether colors
+    stand for several pixels (samples or histogram bins). Otherwise only
+    the local stage does.
     palette_size - The desired palette size.
 
     @note
     The desired palette size is typically not reach. The process finishes early,
     creating a lower amount of clusters that are further split in local.c
 -----------------------------------------------------------------------------*/
-    patolette__ColorClusterArray *result = NULL;
+    patolette__ClusterTable *result = NULL;
+    size_t rows = colors->rows;
+
+    patolette__Vector *moment_weights = NULL;
+    if (weighted && weights != NULL) {
+        moment_weights = patolette__Vector_init(rows);
+        for (size_t i = 0; i < rows; i++) {
+            patolette__Vector_index(moment_weights, i) = patolette__Weights_get(weights, i);
+        }
+    }
 
-    patolette__PCA *pca = patolette__PCA_perform_PCA(colors, NULL);
+    patolette__PCA *pca = patolette__PCA_perform_PCA(colors, moment_weights);
     if (pca == NULL) {
+        patolette__Vector_destroy(moment_weights);
         return result;
     }
 
-    patolette__IndexArray *bucket_map = patolette__SORT_axis_sort(
-        colors, 
-        pca->axis,
-        bucket_count
-    );
-    
+    patolette__UInt16Array *bucket_map = NULL;
     patolette__CellMomentsCache *cache = patolette__CELLS_preprocess(
         colors,
-        bucket_map,
-        bucket_count
+        moment_weights,
+        weighted ? scatter : NULL,
+        pca->axis,
+        bucket_count,
+        &bucket_map
     );
 
     patolette__IndexArray *quantizer = get_principal_quantizer(
@@ -430,13 +502,16 @@ patolette__ColorClusterArray *patolette__GQ_quantize(
         result = get_color_clusters(
             colors,
             weights,
+            scatter,
             quantizer,
-            bucket_map
+            bucket_map,
+            palette_size
         );
     }
 
     patolette__PCA_destroy(pca);
-    patolette__IndexArray_destroy(bucket_map);
+    patolette__Vector_destroy(moment_weights);
+    patolette__UInt16Array_destroy(bucket_map);
     patolette__IndexArray_destroy(quantizer);
     patolette__CellMomentsCache_destroy(cache);
     return result;
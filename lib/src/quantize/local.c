@@ -14,6 +14,13 @@
 
 static const size_t bucket_count = 512;
 
+// Clusters at least this large are split one at a time, with their
+// inner loops split across threads. Smaller ones are split concurrently.
+static const size_t parallel_rows = 1 << 16;
+
+// Batches of clusters smaller than this (in total) are split serially
+static const size_t task_rows = 1 << 12;
+
 /*----------------------------------------------------------------------------
    Constants END
 -----------------------------------------------------------------------------*/
@@ -23,38 +30,40 @@ static const size_t bucket_count = 512;
    Declarations START
 -----------------------------------------------------------------------------*/
 
-typedef struct ClusterPair {
-    patolette__ColorCluster *left;
-    patolette__ColorCluster *right;
-} ClusterPair;
+// A live cluster's slot along with its split benefit, used for ranking
+typedef struct RankedCluster {
+    double benefit;
+    size_t index;
+} RankedCluster;
 
-#define ClusterPairArray patolette__Array
-#define ClusterPairArray_index(a, i) (patolette__Array_index(ClusterPair*, a, i))
-#define ClusterPairArray_init(l) patolette__Array_init(l, sizeof(ClusterPair*))
-#define ClusterPairArray_destroy patolette__Array_destroy
-
-static void destroy_cluster_pair(ClusterPair *pair);
-static ClusterPair *create_cluster_pair(
-    patolette__ColorCluster *left,
-    patolette__ColorCluster *right
+static size_t get_optimal_bucket_index(
+    const patolette__ClusterTable *table,
+    size_t node
 );
 
-static size_t get_optimal_bucket_index(
-    patolette__ColorCluster *cluster,
-    patolette__IndexArray *bucket_map
+static void split_cluster(
+    patolette__ClusterTable *table,
+    size_t node,
+    size_t first_child
 );
 
-static ClusterPair *split_cluster(patolette__ColorCluster *cluster);
+static void split_clusters(
+    patolette__ClusterTable *table,
+    const size_t *nodes,
+    size_t count
+);
 
 static double get_split_benefit(
-    patolette__ColorCluster *cluster,
-    ClusterPair *children
+    const patolette__ClusterTable *table,
+    size_t node
 );
 
-static size_t find_best_cluster_index(
-    patolette__ColorClusterArray *clusters,
-    ClusterPairArray *children,
-    size_t length
+static int compare_ranked_clusters(const void *a, const void *b);
+
+static size_t find_best_cluster_indices(
+    const patolette__ClusterTable *table,
+    size_t count,
+    patolette__IndexArray *indices
 );
 
 /*----------------------------------------------------------------------------
@@ -66,73 +75,82 @@ static size_t find_best_cluster_index(
    Internal functions START
 -----------------------------------------------------------------------------*/
 
-static void destroy_cluster_pair(ClusterPair *pair) {
-/*----------------------------------------------------------------------------
-   Destroys a color cluster pair.
-
-   @param
-   pair - The color cluster pair.
------------------------------------------------------------------------------*/
-    if (pair == NULL) {
-        return;
-    }
-
-    patolette__ColorCluster_destroy(pair->left);
-    patolette__ColorCluster_destroy(pair->right);
-    free(pair);
-}
-
-static ClusterPair *create_cluster_pair(
-    patolette__ColorCluster *left,
-    patolette__ColorCluster *right
-) {
-/*----------------------------------------------------------------------------
-    Creates a color cluster pair.
-
-    @param
-    left - The left cluster.
-    right - The right cluster.
------------------------------------------------------------------------------*/
-    ClusterPair *pair = malloc(sizeof *pair);
-    pair->left = left;
-    pair->right = right;
-    return pair;
-}
-
 static size_t get_optimal_bucket_index(
-    patolette__ColorCluster *cluster,
-    patolette__IndexArray *bucket_map
+    const patolette__ClusterTable *table,
+    size_t node
 ) {
 /*----------------------------------------------------------------------------
     Gets the optimal bucket index to split a cluster at, based on a
     bucket-sorting of the cluster's colors.
 
     @param
-    cluster - The cluster.
-    bucket_map - Describes a bucket-sorting of the colors based on their
-    individual projections onto the color set's principal axis.
+    table - The cluster table. The buffer's bucket ids must describe a
+    bucket-sorting of the cluster's colors based on their individual
+    projections onto the cluster's principal axis.
+    node - The cluster.
 -----------------------------------------------------------------------------*/
-    const patolette__Matrix2D *colors = patolette__ColorCluster_get_colors(cluster);
-    const patolette__Vector *weights = patolette__ColorCluster_get_weights(cluster);
-    
-    // Bucket sizes
-    patolette__IndexArray *sizes = patolette__IndexArray_init(bucket_count);
-
-    // Intra-bucket vector sums
-    patolette__Matrix2D *sums = patolette__Matrix2D_init(3, bucket_count, NULL);
-
-    for (size_t i = 0; i < bucket_map->length; i++) {
-        size_t bucket = patolette__IndexArray_index(bucket_map, i);
-        double cx = patolette__Matrix2D_index(colors, i, 0);
-        double cy = patolette__Matrix2D_index(colors, i, 1);
-        double cz = patolette__Matrix2D_index(colors, i, 2);
-        double weight = weights == NULL ? 1 : patolette__Vector_index(weights, i);
-        patolette__Matrix2D_index(sums, 0, bucket) += cx * weight;
-        patolette__Matrix2D_index(sums, 1, bucket) += cy * weight;
-        patolette__Matrix2D_index(sums, 2, bucket) += cz * weight;
-        patolette__IndexArray_index(sizes, bucket) += weight;
+    const patolette__ClusterBuffer *buffer = table->buffer;
+    const patolette__Matrix2D *colors = buffer->colors;
+    const patolette__FloatArray *weights = buffer->weights;
+    const patolette__UInt16Array *bucket_map = buffer->buckets;
+
+    size_t begin = patolette__IndexArray_index(table->begin, node);
+    size_t end = patolette__IndexArray_index(table->end, node);
+
+    int thread_count = end - begin >= parallel_rows ? omp_get_max_threads() : 1;
+    patolette__Vector **partial_sizes = patolette__ARENA_calloc(
+        (size_t)thread_count,
+        sizeof(patolette__Vector*)
+    );
+    patolette__Matrix2D **partial_sums = patolette__ARENA_calloc(
+        (size_t)thread_count,
+        sizeof(patolette__Matrix2D*)
+    );
+
+    // Each thread builds its own histogram, reduced in thread order below
+    #pragma omp parallel num_threads(thread_count) if (thread_count > 1)
+    {
+        // Bucket sizes (total weight, which need not be whole)
+        patolette__Vector *sizes = patolette__Vector_init(bucket_count);
+
+        // Intra-bucket vector sums
+        patolette__Matrix2D *sums = patolette__Matrix2D_init(3, bucket_count, NULL);
+
+        #pragma omp for schedule(static)
+        for (size_t i = begin; i < end; i++) {
+            size_t bucket = patolette__UInt16Array_index(bucket_map, i);
+            double cx = patolette__Matrix2D_index(colors, i, 0);
+            double cy = patolette__Matrix2D_index(colors, i, 1);
+            double cz = patolette__Matrix2D_index(colors, i, 2);
+            double weight = weights == NULL ? 1 : patolette__FloatArray_index(weights, i);
+            patolette__Matrix2D_index(sums, 0, bucket) += cx * weight;
+            patolette__Matrix2D_index(sums, 1, bucket) += cy * weight;
+            patolette__Matrix2D_index(sums, 2, bucket) += cz * weight;
+            patolette__Vector_index(sizes, bucket) += weight;
+        }
+
+        partial_sizes[omp_get_thread_num()] = sizes;
+        partial_sums[omp_get_thread_num()] = sums;
+    }
+
+    patolette__Vector *sizes = partial_sizes[0];
+    patolette__Matrix2D *sums = partial_sums[0];
+
+    for (int t = 1; t < thread_count; t++) {
+        for (size_t i = 0; i < bucket_count; i++) {
+            patolette__Vector_index(sizes, i) += patolette__Vector_index(partial_sizes[t], i);
+            patolette__Matrix2D_index(sums, 0, i) += patolette__Matrix2D_index(partial_sums[t], 0, i);
+            patolette__Matrix2D_index(sums, 1, i) += patolette__Matrix2D_index(partial_sums[t], 1, i);
+            patolette__Matrix2D_index(sums, 2, i) += patolette__Matrix2D_index(partial_sums[t], 2, i);
+        }
+
+        patolette__Vector_destroy(partial_sizes[t]);
+        patolette__Matrix2D_destroy(partial_sums[t]);
     }
 
+    patolette__ARENA_free(partial_sizes);
+    patolette__ARENA_free(partial_sums);
+
     // Intra-bucket vector sums are made cumulative
     for (size_t i = 1; i < bucket_count; i++) {
         patolette__Matrix2D_index(sums, 0, i) += patolette__Matrix2D_index(sums, 0, i - 1);
@@ -142,7 +160,7 @@ static size_t get_optimal_bucket_index(
 
     // Bucket sizes are made cumulative
     for (size_t i = 1; i < bucket_count; i++) {
-        patolette__IndexArray_index(sizes, i) += patolette__IndexArray_index(sizes, i - 1);
+        patolette__Vector_index(sizes, i) += patolette__Vector_index(sizes, i - 1);
     }
 
     // Objective function
@@ -151,15 +169,15 @@ static size_t get_optimal_bucket_index(
         for (size_t j = 0; j < 3; j++) {
             double csl = patolette__Matrix2D_index(sums, j, i);
             double csr = patolette__Matrix2D_index(sums, j, bucket_count - 1) - csl;
-            double sl = patolette__IndexArray_index(sizes, i);
-            double sr = patolette__IndexArray_index(sizes, bucket_count - 1) - sl;
+            double sl = patolette__Vector_index(sizes, i);
+            double sr = patolette__Vector_index(sizes, bucket_count - 1) - sl;
 
             double v = 0;
-            if (sl != 0) {
+            if (sl > 0) {
                 v += SQ(csl) / sl;
             }
 
-            if (sr != 0) {
+            if (sr > 0) {
                 v += SQ(csr) / sr;
             }
 
@@ -171,139 +189,228 @@ static size_t get_optimal_bucket_index(
     size_t result = patolette__Vector_maxloc(objective);
 
     patolette__Matrix2D_destroy(sums);
-    patolette__IndexArray_destroy(sizes);
+    patolette__Vector_destroy(sizes);
     patolette__Vector_destroy(objective);
     return result;
 }
 
-static ClusterPair *split_cluster(patolette__ColorCluster *cluster) {
+static void split_cluster(
+    patolette__ClusterTable *table,
+    size_t node,
+    size_t first_child
+) {
 /*----------------------------------------------------------------------------
-    Splits a cluster.
+    Splits a cluster. On success, the children are written to nodes
+    first_child and first_child + 1, and linked to the cluster.
 
     @param
-    cluster - The cluster to split.
+    table - The cluster table.
+    node - The cluster to split.
+    first_child - The first of two nodes reserved for the children.
+
+    @note
+    The split is an in-place partition of the cluster's range, so the
+    children are the two halves of that same range. The parent keeps
+    its properties, which don't depend on the order of colors.
 -----------------------------------------------------------------------------*/
-    size_t size = cluster->size;
-    if (size <= 1) {
+    // The split's scratch is released as soon as it's done
+    patolette__ARENA_begin();
+
+    // Needed anyway, even if the cluster can't be split
+    patolette__ClusterTable_compute_stats(table, node);
+
+    size_t size = patolette__ClusterTable_size(table, node);
+    if (size <= 1 || !patolette__BoolArray_index(table->has_axis, node)) {
         // Can't be split
-        return NULL;
+        patolette__ARENA_end();
+        return;
     }
 
-    const patolette__Matrix2D *colors = patolette__ColorCluster_get_colors(cluster);
-    const patolette__Vector *axis = patolette__ColorCluster_get_principal_axis(cluster);
-
-    if (axis == NULL) {
-        return NULL;
+    patolette__Vector *axis = patolette__Vector_init(3);
+    for (size_t j = 0; j < 3; j++) {
+        patolette__Vector_index(axis, j) = patolette__Matrix2D_index(table->axis, node, j);
     }
 
-    patolette__IndexArray *bucket_map = patolette__SORT_axis_sort(
-        colors,
+    patolette__ClusterBuffer *buffer = table->buffer;
+    const patolette__Matrix2D *colors = buffer->colors;
+    size_t begin = patolette__IndexArray_index(table->begin, node);
+    size_t end = patolette__IndexArray_index(table->end, node);
+
+    patolette__SORT_axis_sort(
+        &patolette__Matrix2D_index(colors, begin, 0),
+        &patolette__Matrix2D_index(colors, begin, 1),
+        &patolette__Matrix2D_index(colors, begin, 2),
+        size,
         axis,
-        bucket_count
+        bucket_count,
+        &patolette__UInt16Array_index(buffer->buckets, begin)
     );
 
-    size_t split_index = get_optimal_bucket_index(
-        cluster,
-        bucket_map
-    );
+    patolette__Vector_destroy(axis);
 
-    // Left cluster size
-    size_t left_size = 0;
+    size_t split_index = get_optimal_bucket_index(table, node);
+    size_t middle = patolette__ClusterTable_partition(table, node, split_index);
 
-    // Right cluster size
-    size_t right_size = 0;
+    size_t left = first_child;
+    size_t right = first_child + 1;
+    patolette__ClusterTable_set(table, left, begin, middle, node);
+    patolette__ClusterTable_set(table, right, middle, end, node);
 
-    for (size_t i = 0; i < bucket_map->length; i++) {
-        if (patolette__IndexArray_index(bucket_map, i) <= split_index) {
-            left_size++;
-        }
-        else {
-            right_size++;
-        }
-    }
+    // Computed here, so that it happens in the same (possibly parallel)
+    // context the split does; both are needed to evaluate the split.
+    patolette__ClusterTable_compute_stats(table, left);
+    patolette__ClusterTable_compute_stats(table, right);
+
+    patolette__IndexArray_index(table->left, node) = left;
+    patolette__IndexArray_index(table->right, node) = right;
+
+    patolette__ARENA_end();
+}
 
-    const patolette__IndexArray *indices = cluster->indices;
-    patolette__IndexArray *left_indices = patolette__IndexArray_init(left_size);
-    patolette__IndexArray *right_indices = patolette__IndexArray_init(right_size);
+static void split_clusters(
+    patolette__ClusterTable *table,
+    const size_t *nodes,
+    size_t count
+) {
+/*----------------------------------------------------------------------------
+    Splits a batch of clusters.
 
-    // Two pivots to populate each cluster incrementally
-    size_t pivot_left = 0;
-    size_t pivot_right = 0;
+    @param
+    table - The cluster table.
+    nodes - The clusters to split.
+    count - The number of clusters.
 
-    for (size_t i = 0; i < bucket_map->length; i++) {
-        size_t index = patolette__IndexArray_index(indices, i);
-        if (patolette__IndexArray_index(bucket_map, i) <= split_index) {
-            patolette__IndexArray_index(left_indices, pivot_left) = index;
-            pivot_left++;
+    @note
+    Clusters are disjoint ranges of the working buffer, and two table
+    nodes are reserved up front for each one's children, so they can be
+    split independently. Large clusters are split one at a time, each
+    with its inner loops split across threads, so the biggest cluster
+    doesn't bound the whole batch. The rest are split as tasks, which
+    idle threads steal from each other.
+-----------------------------------------------------------------------------*/
+    size_t first_child = patolette__ClusterTable_reserve(table, 2 * count);
+
+    size_t small_count = 0;
+    size_t small_rows = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t size = patolette__ClusterTable_size(table, nodes[i]);
+        if (size >= parallel_rows) {
+            split_cluster(table, nodes[i], first_child + 2 * i);
         }
         else {
-            patolette__IndexArray_index(right_indices, pivot_right) = index;
-            pivot_right++;
+            small_count++;
+            small_rows += size;
         }
     }
 
-    const patolette__Matrix2D *dataset = cluster->dataset__NOTOWNED__;
-    const patolette__Vector *dataset_weights = cluster->dataset_weights__NOTOWNED__;
-    ClusterPair *children = create_cluster_pair(
-        patolette__ColorCluster_init(dataset, dataset_weights, left_indices),
-        patolette__ColorCluster_init(dataset, dataset_weights, right_indices)
-    );
+    #pragma omp parallel if (small_count > 1 && small_rows >= task_rows)
+    #pragma omp single
+    for (size_t i = 0; i < count; i++) {
+        if (patolette__ClusterTable_size(table, nodes[i]) >= parallel_rows) {
+            continue;
+        }
 
-    patolette__IndexArray_destroy(bucket_map);
-    return children;
+        #pragma omp task firstprivate(i)
+        split_cluster(table, nodes[i], first_child + 2 * i);
+    }
 }
 
 static double get_split_benefit(
-    patolette__ColorCluster *cluster,
-    ClusterPair *children
+    const patolette__ClusterTable *table,
+    size_t node
 ) {
 /*----------------------------------------------------------------------------
     Gets the benefit of splitting a cluster.
 
     @param
-    cluster - The cluster.
-    children - The cluster's children.
+    table - The cluster table.
+    node - The cluster.
 -----------------------------------------------------------------------------*/
-    if (children == NULL) {
+    size_t left = patolette__IndexArray_index(table->left, node);
+    size_t right = patolette__IndexArray_index(table->right, node);
+
+    if (left == patolette__CLUSTER_NONE) {
         return 0;
     }
 
-    double d = patolette__ColorCluster_get_distortion(cluster);
-    double dl = patolette__ColorCluster_get_distortion(children->left);
-    double dr = patolette__ColorCluster_get_distortion(children->right);
+    double d = patolette__Vector_index(table->distortion, node);
+    double dl = patolette__Vector_index(table->distortion, left);
+    double dr = patolette__Vector_index(table->distortion, right);
     return d - (dl + dr);
 }
 
-static size_t find_best_cluster_index(
-    patolette__ColorClusterArray *clusters,
-    ClusterPairArray *children,
-    size_t length
+static int compare_ranked_clusters(const void *a, const void *b) {
+/*----------------------------------------------------------------------------
+    qsort comparator that ranks clusters by decreasing split benefit.
+    Ties are broken by index, so the order is deterministic.
+
+    @param
+    a - The first RankedCluster.
+    b - The second RankedCluster.
+-----------------------------------------------------------------------------*/
+    const RankedCluster *ra = a;
+    const RankedCluster *rb = b;
+
+    if (ra->benefit != rb->benefit) {
+        return ra->benefit > rb->benefit ? -1 : 1;
+    }
+
+    return ra->index < rb->index ? -1 : 1;
+}
+
+static size_t find_best_cluster_indices(
+    const patolette__ClusterTable *table,
+    size_t count,
+    patolette__IndexArray *indices
 ) {
 /*----------------------------------------------------------------------------
-    Finds the index of the best cluster to split.
+    Finds the (live index) slots of the best clusters to split, best
+    first. Returns how many were found, which is less than requested if
+    not enough clusters are worth splitting.
 
     @param
-    clusters - The list of clusters.
-    children - A list containing each cluster's children.
-    length - *Defined* portion of the clusters array (can have padding to the right).
+    table - The cluster table.
+    count - The number of clusters to look for.
+    indices - On exit, the slots of the clusters found.
 -----------------------------------------------------------------------------*/
+    size_t length = table->length;
     patolette__Vector *benefits = patolette__Vector_init(length);
 
     for (size_t i = 0; i < length; i++) {
-        patolette__ColorCluster *cluster = patolette__ColorClusterArray_index(clusters, i);
-        ClusterPair *cluster_children = ClusterPairArray_index(children, i);
+        size_t node = patolette__ClusterTable_live(table, i);
+        patolette__Vector_index(benefits, i) = get_split_benefit(table, node);
+    }
 
-        if (cluster_children == NULL) {
-            patolette__Vector_index(benefits, i) = 0;
-            continue;
+    size_t found = 0;
+
+    if (count == 1) {
+        // Exact greedy order, no need to rank everything
+        size_t best = patolette__Vector_maxloc(benefits);
+        if (patolette__Vector_index(benefits, best) >= patolette__DELTA) {
+            patolette__IndexArray_index(indices, 0) = best;
+            found = 1;
         }
 
-        patolette__Vector_index(benefits, i) = get_split_benefit(cluster, cluster_children);
+        patolette__Vector_destroy(benefits);
+        return found;
+    }
+
+    RankedCluster *ranked = patolette__ARENA_malloc(length * sizeof *ranked);
+    for (size_t i = 0; i < length; i++) {
+        ranked[i].benefit = patolette__Vector_index(benefits, i);
+        ranked[i].index = i;
     }
 
-    size_t result = patolette__Vector_maxloc(benefits);
+    qsort(ranked, length, sizeof *ranked, compare_ranked_clusters);
+
+    while (found < count && found < length && ranked[found].benefit >= patolette__DELTA) {
+        patolette__IndexArray_index(indices, found) = ranked[found].index;
+        found++;
+    }
+
+    patolette__ARENA_free(ranked);
     patolette__Vector_destroy(benefits);
-    return result;
+    return found;
 }
 
 /*----------------------------------------------------------------------------
@@ -315,94 +422,135 @@ static size_t find_best_cluster_index(
     Exported functions START
 -----------------------------------------------------------------------------*/
 
-patolette__ColorClusterArray *patolette__LQ_quantize(
-    patolette__ColorClusterArray *clusters,
+void patolette__LQ_quantize(
+    patolette__ClusterTable *table,
     size_t palette_size,
+    double batch_ratio,
+    double target_distortion,
     bool verbose
 ) {
 /*----------------------------------------------------------------------------
     Splits a set of K color clusters into N > K color clusters.
 
     @params
-    clusters - The initial list of clusters.
+    table - The cluster table. Its live clusters are the initial clusters,
+    and are replaced by the resulting ones.
     palette_size - The desired palette size (N).
+    batch_ratio - Fraction of the remaining palette budget to split at
+    once in each round. Anything <= 0 splits one cluster per round.
+    target_distortion - Splitting stops early once the total distortion
+    per unit of weight is at most this. Anything <= 0 disables it.
+    verbose - Whether to print progress to the console.
+
+    @note
+    The table must have room for 4N - K nodes: every split of a cluster
+    adds two nodes, and the children of every live cluster are computed
+    ahead of time.
 
     @note
-    The input list of clusters is modified. Its items are set to
-    NULL if destroyed.
+    Splits are logged in the table, in order. Split s moves the left child
+    to the new slot K + s and keeps the right child in the parent's slot,
+    so the first P live clusters after P - K splits are the P-cluster
+    quantization, and every slot only ever holds descendants of what it
+    held before.
+
+    @note
+    With one split per round, the cluster with the highest split benefit
+    is always split next (exact greedy order). With batches, the top-m
+    clusters by split benefit are split at once, and all of their children
+    are split (speculatively) in parallel. The budget shrinks geometrically,
+    so large palettes take O(log N) rounds instead of N - K steps, at the
+    cost of not re-ranking between the splits of a round.
 -----------------------------------------------------------------------------*/
-    if (clusters->length >= palette_size) {
-        return clusters;
+    if (table->length >= palette_size) {
+        for (size_t i = 0; i < table->length; i++) {
+            patolette__ClusterTable_compute_stats(table, patolette__ClusterTable_live(table, i));
+        }
+        return;
     }
 
-    patolette__ColorClusterArray *result = patolette__ColorClusterArray_init(palette_size);
-    patolette__ColorClusterArray_copy_into(clusters, result);
+    split_clusters(table, table->live->data, table->length);
 
-    ClusterPairArray *children = ClusterPairArray_init(palette_size);
-    for (size_t i = 0; i < clusters->length; i++) {
-        patolette__ColorCluster *cluster = patolette__ColorClusterArray_index(clusters, i);
-        ClusterPairArray_index(children, i) = split_cluster(cluster);
+    // Total distortion, tracked through split benefits
+    double distortion = 0;
+    double weight = 0;
+    for (size_t i = 0; i < table->length; i++) {
+        size_t node = patolette__ClusterTable_live(table, i);
+        distortion += patolette__Vector_index(table->distortion, node);
+        weight += patolette__Vector_index(table->weight, node);
     }
 
-    for (size_t i = clusters->length; i < palette_size; i++) {
-        size_t best_cluster_index = find_best_cluster_index(
-            result,
-            children,
-            i
-        );
-
-        patolette__ColorCluster *best_cluster = patolette__ColorClusterArray_index(
-            result,
-            best_cluster_index
-        );
-
-        ClusterPair *best_cluster_children = ClusterPairArray_index(
-            children,
-            best_cluster_index
-        );
-
-        double benefit = get_split_benefit(best_cluster, best_cluster_children);
-        if (benefit < patolette__DELTA) {
-            patolette__ColorClusterArray *slice = patolette__ColorClusterArray_slice(result, 0, i);
-            patolette__ColorClusterArray_destroy(result);
-            result = slice;
+    bool targeted = target_distortion > 0;
+    double threshold = target_distortion * weight;
+
+    // Scratch space for each round. A round splits at most
+    // min(length, palette_size - length) clusters.
+    patolette__IndexArray *best_indices = patolette__IndexArray_init(palette_size);
+    patolette__IndexArray *pending = patolette__IndexArray_init(palette_size);
+
+    while (table->length < palette_size && (!targeted || distortion > threshold)) {
+        size_t length = table->length;
+        size_t budget = palette_size - length;
+        size_t batch_size = 1;
+        if (batch_ratio > 0) {
+            batch_size = (size_t)ceil(batch_ratio * (double)budget);
+            batch_size = min(batch_size, budget);
+        }
+
+        // Each round's scratch is released before the next one
+        patolette__ARENA_begin();
+
+        size_t found = find_best_cluster_indices(table, batch_size, best_indices);
+
+        if (found == 0) {
+            patolette__ARENA_end();
             break;
         }
 
-        patolette__ColorCluster *left = best_cluster_children->left;
-        patolette__ColorCluster *right = best_cluster_children->right;
+        size_t applied = 0;
+        for (size_t r = 0; r < found; r++) {
+            if (targeted && distortion <= threshold) {
+                break;
+            }
+
+            size_t slot = patolette__IndexArray_index(best_indices, r);
+            size_t node = patolette__ClusterTable_live(table, slot);
+            size_t left = patolette__IndexArray_index(table->left, node);
+            size_t right = patolette__IndexArray_index(table->right, node);
+
+            patolette__ClusterTable_live(table, length + r) = left;
+            patolette__ClusterTable_live(table, slot) = right;
 
-        patolette__ColorClusterArray_index(result, i) = left;
-        patolette__ColorClusterArray_index(result, best_cluster_index) = right;
+            size_t split = table->split_count++;
+            patolette__IndexArray_index(table->split_nodes, split) = node;
+            patolette__IndexArray_index(table->split_slots, split) = slot;
 
-        ClusterPairArray_index(children, i) = split_cluster(left);
-        ClusterPairArray_index(children, best_cluster_index) = split_cluster(right);
+            patolette__IndexArray_index(pending, 2 * r) = left;
+            patolette__IndexArray_index(pending, 2 * r + 1) = right;
 
-        patolette__ColorCluster_destroy(best_cluster);
-        if (best_cluster_index < clusters->length) {
-            patolette__ColorClusterArray_index(clusters, best_cluster_index) = NULL;
+            distortion -= get_split_benefit(table, node);
+            applied++;
         }
 
+        table->length = length + applied;
+        split_clusters(table, pending->data, 2 * applied);
+
+        patolette__ARENA_end();
+
         if (verbose) {
-            printf("patolette ======== Processed colors: %zu\r", i + 1);
+            printf("patolette ======== Processed colors: %zu\r", table->length);
             fflush(stdout);
         }
     }
 
-    for (size_t i = 0; i < children->length; i++) {
-        ClusterPair *pair = ClusterPairArray_index(children, i);
-        destroy_cluster_pair(pair);
-    }
-
-    ClusterPairArray_destroy(children);
+    patolette__IndexArray_destroy(best_indices);
+    patolette__IndexArray_destroy(pending);
 
     if (verbose) {
         printf("\n");
     }
-
-    return result;
 }
 
 /*----------------------------------------------------------------------------
     Exported functions END
------------------------------------------------------------------------------*/
\ No newline at end of file
+-----------------------------------------------------------------------------*/
@@ -0,0 +1,182 @@
+#include "quantize/pyramid.h"
+
+/*----------------------------------------------------------------------------
+   Image pyramids, used to generate palettes from a downscaled version of
+   very large images.
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Constants START
+-----------------------------------------------------------------------------*/
+
+// Levels smaller than this are not worth splitting across threads
+static const size_t parallel_pixels = 1 << 16;
+
+/*----------------------------------------------------------------------------
+   Constants END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Declarations START
+-----------------------------------------------------------------------------*/
+
+static patolette__Matrix2D *halve(
+    const patolette__Matrix2D *colors,
+    const patolette__Weights *weights,
+    size_t width,
+    size_t height,
+    bool decode,
+    patolette__Vector **half_weights
+);
+
+/*----------------------------------------------------------------------------
+   Declarations END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Internal functions START
+-----------------------------------------------------------------------------*/
+
+static patolette__Matrix2D *halve(
+    const patolette__Matrix2D *colors,
+    const patolette__Weights *weights,
+    size_t width,
+    size_t height,
+    bool decode,
+    patolette__Vector **half_weights
+) {
+/*----------------------------------------------------------------------------
+   Downscales an image by a factor of 2 (box filter). Each pixel of the
+   result is the weighted mean of a 2x2 block (smaller at odd edges), and
+   its weight is the block's total weight.
+
+   @params
+   colors - The image colors in linear light, or in sRGB if decode.
+   weights - Weight of each color, or NULL (all 1).
+   width - The width of the image.
+   height - The height of the image.
+   decode - Whether colors are in sRGB, and must be gamma decoded first.
+   half_weights - On exit, the weight of each pixel of the result.
+-----------------------------------------------------------------------------*/
+    size_t half_width = (width + 1) / 2;
+    size_t half_height = (height + 1) / 2;
+    size_t count = half_width * half_height;
+
+    patolette__Matrix2D *half = patolette__Matrix2D_init(count, 3, NULL);
+    patolette__Vector *result_weights = patolette__Vector_init(count);
+
+    #pragma omp parallel for schedule(static) if (count >= parallel_pixels)
+    for (size_t hy = 0; hy < half_height; hy++) {
+        for (size_t hx = 0; hx < half_width; hx++) {
+            double sums[3] = {0, 0, 0};
+            double w_sum = 0;
+
+            for (size_t y = 2 * hy; y < min(2 * hy + 2, height); y++) {
+                for (size_t x = 2 * hx; x < min(2 * hx + 2, width); x++) {
+                    size_t i = y * width + x;
+                    double w = weights == NULL ? 1 : patolette__Weights_get(weights, i);
+
+                    for (size_t j = 0; j < 3; j++) {
+                        double c = patolette__Matrix2D_index(colors, i, j);
+                        if (decode) {
+                            c = patolette__COLOR_sRGB_gamma_decode(c);
+                        }
+                        sums[j] += w * c;
+                    }
+
+                    w_sum += w;
+                }
+            }
+
+            size_t k = hy * half_width + hx;
+            patolette__Matrix2D_index(half, k, 0) = sums[0] / w_sum;
+            patolette__Matrix2D_index(half, k, 1) = sums[1] / w_sum;
+            patolette__Matrix2D_index(half, k, 2) = sums[2] / w_sum;
+            patolette__Vector_index(result_weights, k) = w_sum;
+        }
+    }
+
+    *half_weights = result_weights;
+    return half;
+}
+
+/*----------------------------------------------------------------------------
+   Internal functions END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Exported functions START
+-----------------------------------------------------------------------------*/
+
+patolette__Matrix2D *patolette__PYRAMID_downscale(
+    const patolette__Matrix2D *colors,
+    const patolette__Weights *weights,
+    size_t width,
+    size_t height,
+    size_t max_pixels,
+    size_t *level_width,
+    size_t *level_height,
+    patolette__Vector **level_weights
+) {
+/*----------------------------------------------------------------------------
+   Downscales an image by factors of 2 until it has at most max_pixels
+   pixels. Averaging is done in linear light.
+
+   @params
+   colors - The image colors in sRGB[0, 1] space, scanned from
+   left-to-right, top-to-bottom.
+   weights - Weight of each color, or NULL.
+   width - The width of the image.
+   height - The height of the image.
+   max_pixels - The pixel budget.
+   level_width - On exit, the width of the result.
+   level_height - On exit, the height of the result.
+   level_weights - On exit, the weight of each pixel of the result. Each
+   pixel weighs as much as the pixels it covers together, so the result's
+   weighted color distribution approximates the image's.
+
+   @note
+   The result is in sRGB[0, 1] space. The image is always halved at
+   least once, so this is only meant for images over the budget.
+
+   @note
+   Only one level is kept at a time; the first one is gamma decoded on
+   the fly so the full resolution image is never copied.
+-----------------------------------------------------------------------------*/
+    patolette__Vector *level_w = NULL;
+    patolette__Matrix2D *level = halve(colors, weights, width, height, true, &level_w);
+    width = (width + 1) / 2;
+    height = (height + 1) / 2;
+
+    while (width * height > max(max_pixels, 1)) {
+        patolette__Weights *current_w = patolette__Weights_from_vector(level_w);
+        patolette__Vector *next_w = NULL;
+        patolette__Matrix2D *next = halve(level, current_w, width, height, false, &next_w);
+        patolette__Matrix2D_destroy(level);
+        patolette__Weights_destroy(current_w);
+        level = next;
+        level_w = next_w;
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+
+    for (size_t i = 0; i < level->rows; i++) {
+        for (size_t j = 0; j < 3; j++) {
+            double c = patolette__Matrix2D_index(level, i, j);
+            patolette__Matrix2D_index(level, i, j) = patolette__COLOR_sRGB_gamma_encode(c);
+        }
+    }
+
+    *level_width = width;
+    *level_height = height;
+    *level_weights = level_w;
+    return level;
+}
+
+/*----------------------------------------------------------------------------
+   Exported functions END
+-----------------------------------------------------------------------------*/
@@ -0,0 +1,127 @@
+#include "quantize/sample.h"
+
+/*----------------------------------------------------------------------------
+   Spatially stratified subsampling of images, used to bound the cost of
+   palette generation on very large images.
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Constants START
+-----------------------------------------------------------------------------*/
+
+// Sample counts below this are not worth splitting across threads
+static const size_t parallel_samples = 1 << 16;
+
+/*----------------------------------------------------------------------------
+   Constants END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Declarations START
+-----------------------------------------------------------------------------*/
+
+static uint64_t hash(uint64_t x);
+
+/*----------------------------------------------------------------------------
+   Declarations END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Internal functions START
+-----------------------------------------------------------------------------*/
+
+static uint64_t hash(uint64_t x) {
+/*----------------------------------------------------------------------------
+   Hashes an integer (splitmix64 finalizer).
+
+   @params
+   x - The integer.
+-----------------------------------------------------------------------------*/
+    x += 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
+
+/*----------------------------------------------------------------------------
+   Internal functions END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Exported functions START
+-----------------------------------------------------------------------------*/
+
+patolette__Matrix2D *patolette__SAMPLE_stratified(
+    const patolette__Matrix2D *colors,
+    const patolette__Weights *weights,
+    size_t width,
+    size_t height,
+    size_t max_samples,
+    patolette__Vector **sample_weights
+) {
+/*----------------------------------------------------------------------------
+   Draws a spatially stratified sample of an image's colors.
+
+   The image is divided into square tiles, so that there are about
+   max_samples of them, and one pixel is picked from each one. Each
+   sample is weighted by the area of its tile (times its own weight),
+   so that the sample's weighted color distribution approximates the
+   image's.
+
+   @params
+   colors - The image colors, scanned from left-to-right, top-to-bottom.
+   weights - Weight of each color, or NULL.
+   width - The width of the image.
+   height - The height of the image.
+   max_samples - The (approximate) number of samples to draw.
+   sample_weights - On exit, the weight of each sample.
+
+   @note
+   The pixel picked from each tile is given by a hash of the tile's
+   index, so sampling is deterministic, but doesn't alias with regular
+   patterns in the image the way a fixed offset would.
+-----------------------------------------------------------------------------*/
+    size_t tile = (size_t)ceil(sqrt((double)(width * height) / (double)max(max_samples, 1)));
+    tile = max(tile, 1);
+
+    size_t tiles_x = (width + tile - 1) / tile;
+    size_t tiles_y = (height + tile - 1) / tile;
+    size_t count = tiles_x * tiles_y;
+
+    patolette__Matrix2D *samples = patolette__Matrix2D_init(count, 3, NULL);
+    patolette__Vector *result_weights = patolette__Vector_init(count);
+
+    #pragma omp parallel for schedule(static) if (count >= parallel_samples)
+    for (size_t t = 0; t < count; t++) {
+        size_t tx = t % tiles_x;
+        size_t ty = t / tiles_x;
+
+        size_t x0 = tx * tile;
+        size_t y0 = ty * tile;
+        size_t tw = min(tile, width - x0);
+        size_t th = min(tile, height - y0);
+
+        uint64_t h = hash(t);
+        size_t x = x0 + (size_t)(h % tw);
+        size_t y = y0 + (size_t)((h >> 32) % th);
+        size_t i = y * width + x;
+
+        patolette__Matrix2D_index(samples, t, 0) = patolette__Matrix2D_index(colors, i, 0);
+        patolette__Matrix2D_index(samples, t, 1) = patolette__Matrix2D_index(colors, i, 1);
+        patolette__Matrix2D_index(samples, t, 2) = patolette__Matrix2D_index(colors, i, 2);
+
+        double weight = weights == NULL ? 1 : patolette__Weights_get(weights, i);
+        patolette__Vector_index(result_weights, t) = weight * (double)(tw * th);
+    }
+
+    *sample_weights = result_weights;
+    return samples;
+}
+
+/*----------------------------------------------------------------------------
+   Exported functions END
+-----------------------------------------------------------------------------*/
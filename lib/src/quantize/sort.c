@@ -5,91 +5,136 @@
 -----------------------------------------------------------------------------*/
 
 
+/*----------------------------------------------------------------------------
+   Constants START
+-----------------------------------------------------------------------------*/
+
+// Lists of colors below this size are not worth splitting across threads
+static const size_t parallel_rows = 1 << 16;
+
+/*----------------------------------------------------------------------------
+   Constants END
+-----------------------------------------------------------------------------*/
+
+
 /*----------------------------------------------------------------------------
    Exported functions START
 -----------------------------------------------------------------------------*/
 
-patolette__IndexArray *patolette__SORT_axis_sort(
-    const patolette__Matrix2D *colors,
+patolette__AxisBucketing patolette__SORT_get_bucketing(
+    const double *cx,
+    const double *cy,
+    const double *cz,
+    size_t length,
     const patolette__Vector *axis,
     size_t bucket_count
 ) {
+/*----------------------------------------------------------------------------
+   Gets the bucketing of a list of colors based on their projection onto
+   a supplied axis, i.e. finds the range of the projections.
+
+   @param
+   cx, cy, cz - The color components of the list of colors.
+   length - The number of colors.
+   axis - The axis to sort based on.
+   bucket_count - The number of buckets to use.
+
+   @note
+   Projections are not stored; patolette__SORT_bucket computes them again
+   on the fly, which is cheaper than an N-length temporary.
+-----------------------------------------------------------------------------*/
+    patolette__AxisBucketing bucketing;
+    bucketing.axis[0] = patolette__Vector_index(axis, 0);
+    bucketing.axis[1] = patolette__Vector_index(axis, 1);
+    bucketing.axis[2] = patolette__Vector_index(axis, 2);
+    bucketing.bucket_count = bucket_count;
+
+    double ax = bucketing.axis[0];
+    double ay = bucketing.axis[1];
+    double az = bucketing.axis[2];
+
+    double min_dot = INFINITY;
+    double max_dot = -INFINITY;
+
+    #pragma omp parallel for simd if (length >= parallel_rows) reduction(min:min_dot) reduction(max:max_dot)
+    for (size_t i = 0; i < length; i++) {
+        double dot = cx[i] * ax + cy[i] * ay + cz[i] * az;
+        min_dot = fmin(min_dot, dot);
+        max_dot = fmax(max_dot, dot);
+    }
+
+    bucketing.low = min_dot;
+    bucketing.scale = 0;
+
+    if (max_dot - min_dot >= patolette__DELTA) {
+        bucketing.scale = 1 / (max_dot - min_dot);
+    }
+
+    return bucketing;
+}
+
+void patolette__SORT_axis_sort(
+    const double *cx,
+    const double *cy,
+    const double *cz,
+    size_t length,
+    const patolette__Vector *axis,
+    size_t bucket_count,
+    uint16_t *buckets
+) {
 /*----------------------------------------------------------------------------
    Bucket sorts a list of colors based on their projection onto a supplied
    axis. Each bucket is not itself internally sorted.
 
+   This takes two vectorized passes over the colors: one to find the
+   range of the projections, and one to project (again) and bin.
+
    @param
-   colors - The list of colors.
+   cx, cy, cz - The color components of the list of colors.
+   length - The number of colors.
    axis - The axis to sort based on.
-   bucket_count - The number of buckets to use.
+   bucket_count - The number of buckets to use (at most 65536).
+   buckets - On exit, the bucket of each color.
+
+   @note
+   The colors are taken as separate components so that any contiguous
+   range of a column-major color matrix can be sorted.
 -----------------------------------------------------------------------------*/
-    size_t rows = colors->rows;
-    size_t cols = colors->cols;
-
-    patolette__IndexArray *map = patolette__IndexArray_init(rows);
-    patolette__Vector *dots = patolette__Vector_init(rows);
-
-    blasint m = (blasint)rows;
-    blasint n = (blasint)cols;
-    double alpha = 1;
-    double *a = colors->data;
-    blasint lda = m;
-    double *x = axis->data;
-    blasint incx = 1;
-    double beta = 0;
-    double *y = dots->data;
-    blasint incy = 1;
-
-    cblas_dgemv(
-        CblasColMajor,
-        CblasNoTrans,
-        m,
-        n,
-        alpha,
-        a,
-        lda,
-        x,
-        incx,
-        beta,
-        y,
-        incy
+    patolette__AxisBucketing bucketing = patolette__SORT_get_bucketing(
+        cx,
+        cy,
+        cz,
+        length,
+        axis,
+        bucket_count
     );
 
-    double min_dot = patolette__Vector_min(dots);
-    double max_dot = patolette__Vector_max(dots);
-
-    if (max_dot - min_dot < patolette__DELTA) {
-        // In this case just assign buckets incrementally.
-        // This might be very stupid. Maybe it's better to
-        // switch between the first and last bucket, but
-        // most likely it will never matter.
-        size_t j = 0;
-        for (size_t i = 0; i < rows; i++) {
-            patolette__IndexArray_index(map, i) = j;
-            if (j >= bucket_count - 1) {
-                j = 0;
-            }
-            else {
-                j++;
-            }
+    if (bucketing.scale == 0) {
+        for (size_t i = 0; i < length; i++) {
+            buckets[i] = (uint16_t)(i % bucket_count);
         }
 
-        patolette__Vector_destroy(dots);
-        return map;
+        return;
     }
 
-    double s = 1 / (max_dot - min_dot);
-    for (size_t i = 0; i < rows; i++) {
-        double dot = patolette__Vector_index(dots, i);
-        double ratio = (dot - min_dot) * s;
-        size_t bucket = (size_t)((double)bucket_count * ratio);
-        patolette__IndexArray_index(map, i) = min(bucket, bucket_count - 1);
-    }
+    double ax = bucketing.axis[0];
+    double ay = bucketing.axis[1];
+    double az = bucketing.axis[2];
+    double low = bucketing.low;
+    double scale = bucketing.scale * (double)bucket_count;
+    double last = (double)(bucket_count - 1);
 
-    patolette__Vector_destroy(dots);
-    return map;
+    #pragma omp parallel for simd if (length >= parallel_rows)
+    for (size_t i = 0; i < length; i++) {
+        double dot = cx[i] * ax + cy[i] * ay + cz[i] * az;
+        double bucket = (dot - low) * scale;
+        // Plain comparisons rather than fmin / fmax so the loop vectorizes
+        bucket = bucket > 0 ? bucket : 0;
+        bucket = bucket < last ? bucket : last;
+        buckets[i] = (uint16_t)(int32_t)bucket;
+    }
 }
 
 /*----------------------------------------------------------------------------
    Exported functions END
------------------------------------------------------------------------------*/
\ No newline at end of file
+-----------------------------------------------------------------------------*/
@@ -0,0 +1,234 @@
+#include "quantize/weights.h"
+
+/*----------------------------------------------------------------------------
+    patolette__Weights
+
+    This file defines functions that evaluate color weights. The actual
+    patolette__Weights definition can be found in "quantize/weights.h"
+
+    Weights are looked up one color at a time, wherever they're used
+    (downscaling, sampling, binning, refinement), so compact maps (low
+    resolution grids, quantized maps, regions) are never expanded to one
+    double per color. Clustering is the exception: the cluster buffer
+    keeps a single precision copy, permuted along with its colors.
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+    Declarations START
+-----------------------------------------------------------------------------*/
+
+static double get_grid_weight(const patolette__Weights *weights, size_t x, size_t y);
+static double get_region_weight(const patolette__Weights *weights, size_t x, size_t y);
+
+/*----------------------------------------------------------------------------
+    Declarations END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+    Internal functions START
+-----------------------------------------------------------------------------*/
+
+static double get_grid_weight(const patolette__Weights *weights, size_t x, size_t y) {
+/*----------------------------------------------------------------------------
+    Bilinearly samples a grid weight map at a pixel. Pixel centers are
+    aligned with grid cell centers, and samples are clamped at the edges.
+    Cells span grid_cell_size pixels (e.g. the blocks an image was
+    downscaled by, the last ones possibly cut short), or if that's 0, an
+    equal share of the image.
+
+    @params
+    weights - The weights (a grid map).
+    x - The pixel column.
+    y - The pixel row.
+-----------------------------------------------------------------------------*/
+    const double *grid = weights->map.data;
+    size_t grid_width = weights->map.grid_width;
+    size_t grid_height = weights->map.grid_height;
+
+    double cell_size = weights->map.grid_cell_size;
+    double scale_x = cell_size > 0 ? 1 / cell_size : (double)grid_width / weights->width;
+    double scale_y = cell_size > 0 ? 1 / cell_size : (double)grid_height / weights->height;
+    double max_x = (double)(grid_width - 1);
+    double max_y = (double)(grid_height - 1);
+
+    double fx = min(max((x + 0.5) * scale_x - 0.5, 0.0), max_x);
+    double fy = min(max((y + 0.5) * scale_y - 0.5, 0.0), max_y);
+    size_t x0 = (size_t)fx;
+    size_t y0 = (size_t)fy;
+    size_t x1 = min(x0 + 1, grid_width - 1);
+    size_t y1 = min(y0 + 1, grid_height - 1);
+    double tx = fx - x0;
+    double ty = fy - y0;
+
+    const double *row0 = &grid[y0 * grid_width];
+    const double *row1 = &grid[y1 * grid_width];
+
+    double top = row0[x0] + tx * (row0[x1] - row0[x0]);
+    double bottom = row1[x0] + tx * (row1[x1] - row1[x0]);
+    return top + ty * (bottom - top);
+}
+
+static double get_region_weight(const patolette__Weights *weights, size_t x, size_t y) {
+/*----------------------------------------------------------------------------
+    Gets the weight of a pixel from a region map: the product of the
+    boosts of the regions that hold its center.
+
+    @params
+    weights - The weights (a region map).
+    x - The pixel column.
+    y - The pixel row.
+-----------------------------------------------------------------------------*/
+    const patolette__WeightRegion *regions = weights->map.data;
+    double px = x + 0.5;
+    double py = y + 0.5;
+
+    double weight = 1;
+    for (size_t r = 0; r < weights->map.region_count; r++) {
+        const patolette__WeightRegion *region = &regions[r];
+        double dx = px - region->x;
+        double dy = py - region->y;
+        if (dx < 0 || dy < 0 || dx >= region->width || dy >= region->height) {
+            continue;
+        }
+
+        if (region->shape == patolette__RegionEllipse) {
+            double ax = region->width / 2;
+            double ay = region->height / 2;
+            if (SQ((dx - ax) / ax) + SQ((dy - ay) / ay) > 1) {
+                continue;
+            }
+        }
+
+        weight *= region->boost;
+    }
+
+    return weight;
+}
+
+/*----------------------------------------------------------------------------
+    Internal functions END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+    Exported functions START
+-----------------------------------------------------------------------------*/
+
+void patolette__Weights_destroy(patolette__Weights *weights) {
+/*----------------------------------------------------------------------------
+    Destroys weights, along with the storage they own.
+
+    @params
+    weights - The weights to destroy.
+-----------------------------------------------------------------------------*/
+    if (weights == NULL) {
+        return;
+    }
+
+    patolette__Array_destroy(weights->owned);
+    patolette__ARENA_free(weights);
+}
+
+patolette__Weights *patolette__Weights_init(
+    const patolette__WeightMap *map,
+    size_t width,
+    size_t height,
+    patolette__Array *owned
+) {
+/*----------------------------------------------------------------------------
+    Initializes weights from a weight map.
+
+    @params
+    map - The weight map, expected to be valid (check
+    patolette__Weights_is_valid_map). It is copied, but its data is not.
+    width - The width of the image the map is evaluated for.
+    height - The height of the image the map is evaluated for.
+    owned - Storage the weights take ownership of (typically the map's
+    data), or NULL.
+-----------------------------------------------------------------------------*/
+    patolette__Weights *weights = patolette__ARENA_malloc(sizeof *weights);
+    weights->map = *map;
+    weights->width = width;
+    weights->height = height;
+    weights->owned = owned;
+    return weights;
+}
+
+patolette__Weights *patolette__Weights_from_vector(patolette__Vector *weights) {
+/*----------------------------------------------------------------------------
+    Initializes (dense) weights from one weight per color. The weights
+    take ownership of the vector.
+
+    @params
+    weights - The weight of each color.
+-----------------------------------------------------------------------------*/
+    patolette__WeightMap map = {0};
+    map.kind = patolette__WeightsDense;
+    map.data = weights->data;
+    return patolette__Weights_init(&map, weights->length, 1, weights);
+}
+
+bool patolette__Weights_is_valid_map(const patolette__WeightMap *map) {
+/*----------------------------------------------------------------------------
+    Checks whether a weight map is well formed (the weight values
+    themselves are not checked).
+
+    @params
+    map - The weight map.
+-----------------------------------------------------------------------------*/
+    if (map->kind == patolette__WeightsRegions) {
+        return map->region_count == 0 || map->data != NULL;
+    }
+
+    if (map->data == NULL) {
+        return false;
+    }
+
+    if (map->kind == patolette__WeightsGrid) {
+        return map->grid_width > 0 && map->grid_height > 0 && map->grid_cell_size >= 0;
+    }
+
+    return (
+        map->kind == patolette__WeightsDense ||
+        map->kind == patolette__WeightsUInt8 ||
+        map->kind == patolette__WeightsUInt16
+    );
+}
+
+double patolette__Weights_get(const patolette__Weights *weights, size_t i) {
+/*----------------------------------------------------------------------------
+    Gets the weight of a color.
+
+    @params
+    weights - The weights.
+    i - The index of the color.
+-----------------------------------------------------------------------------*/
+    const patolette__WeightMap *map = &weights->map;
+
+    if (map->kind == patolette__WeightsDense) {
+        return ((const double *)map->data)[i];
+    }
+
+    else if (map->kind == patolette__WeightsUInt8) {
+        return 1 + map->scale * ((const uint8_t *)map->data)[i];
+    }
+
+    else if (map->kind == patolette__WeightsUInt16) {
+        return 1 + map->scale * ((const uint16_t *)map->data)[i];
+    }
+
+    size_t x = i % weights->width;
+    size_t y = i / weights->width;
+
+    if (map->kind == patolette__WeightsGrid) {
+        return get_grid_weight(weights, x, y);
+    }
+
+    return get_region_weight(weights, x, y);
+}
+
+/*----------------------------------------------------------------------------
+    Exported functions END
+-----------------------------------------------------------------------------*/
@@ -0,0 +1,425 @@
+#include "saliency/density.h"
+
+/*----------------------------------------------------------------------------
+   Color density based color weights.
+
+   A cheap alternative to saliency that looks at the color distribution
+   only: colors whose neighbourhood in color space holds few pixels are
+   rare, and are given higher weight for palette generation, so small
+   distinctive clusters aren't swallowed by large ones.
+
+   Colors are deduplicated into a histogram first. The occupied bins are
+   then spread over a coarse CIELab grid, which is blurred, so each cell
+   ends up holding (roughly) the number of pixels around it. A color's
+   rarity is read from that grid. All of this depends on the number of
+   bins only, not on the number of pixels.
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Constants START
+-----------------------------------------------------------------------------*/
+
+// Bits per axis of the (sRGB) histogram colors are deduplicated into
+static const int density_bits = 6;
+
+// Edge of the CIELab grid cells densities are estimated over
+static const double density_cell = 4;
+
+// Blur applied along each axis of the CIELab grid (binomial, so that the
+// three passes add up to a gaussian-like neighbourhood)
+static const double blur_kernel[] = { 1.0 / 16, 4.0 / 16, 6.0 / 16, 4.0 / 16, 1.0 / 16 };
+static const long blur_radius = 2;
+
+// Pixels rarer than this fraction of the image get the full weight
+static const double rare_ratio = 0.01;
+
+// Images smaller than this are not worth splitting across threads
+static const size_t parallel_pixels = 1 << 16;
+
+/*----------------------------------------------------------------------------
+   Constants END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Declarations START
+-----------------------------------------------------------------------------*/
+
+typedef struct RankedBin {
+    double density;
+    double count;
+} RankedBin;
+
+// A regular grid over CIELab, x-major
+typedef struct DensityGrid {
+    // The lower corner of the grid
+    double origin[3];
+
+    // The number of cells along each axis
+    size_t dims[3];
+
+    // The value of each cell
+    double *cells;
+} DensityGrid;
+
+static int compare_ranked_bins(const void *a, const void *b);
+static inline size_t get_bin(
+    const patolette__Matrix2D *colors,
+    size_t i,
+    size_t levels
+);
+static void locate(
+    const DensityGrid *grid,
+    const double *color,
+    size_t *corner,
+    double *fraction
+);
+static void splat(DensityGrid *grid, const double *color, double count);
+static double sample(const DensityGrid *grid, const double *color);
+static void blur(DensityGrid *grid, size_t axis);
+
+/*----------------------------------------------------------------------------
+   Declarations END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Internal functions START
+-----------------------------------------------------------------------------*/
+
+static int compare_ranked_bins(const void *a, const void *b) {
+/*----------------------------------------------------------------------------
+   qsort comparator that ranks bins by increasing density (i.e. by
+   decreasing rarity).
+
+   @param
+   a - The first RankedBin.
+   b - The second RankedBin.
+-----------------------------------------------------------------------------*/
+    const RankedBin *ra = a;
+    const RankedBin *rb = b;
+
+    if (ra->density != rb->density) {
+        return ra->density < rb->density ? -1 : 1;
+    }
+
+    return 0;
+}
+
+static inline size_t get_bin(
+    const patolette__Matrix2D *colors,
+    size_t i,
+    size_t levels
+) {
+/*----------------------------------------------------------------------------
+   Gets the histogram bin of a color.
+
+   @params
+   colors - The colors, in sRGB[0, 1] space.
+   i - The index of the color.
+   levels - The number of bins along each axis.
+-----------------------------------------------------------------------------*/
+    size_t bin = 0;
+    for (size_t j = 0; j < 3; j++) {
+        double c = patolette__Matrix2D_index(colors, i, j) * levels;
+        size_t b = c > 0 ? (size_t)c : 0;
+        bin = bin * levels + (b < levels ? b : levels - 1);
+    }
+
+    return bin;
+}
+
+static void locate(
+    const DensityGrid *grid,
+    const double *color,
+    size_t *corner,
+    double *fraction
+) {
+/*----------------------------------------------------------------------------
+   Locates a color within a density grid, for trilinear interpolation.
+
+   @params
+   grid - The density grid.
+   color - The color, in CIELab space.
+   corner - The lower corner of the cell the color falls in (filled).
+   fraction - The color's offset from that corner, in cells (filled).
+-----------------------------------------------------------------------------*/
+    for (size_t j = 0; j < 3; j++) {
+        double offset = max((color[j] - grid->origin[j]) / density_cell, 0.0);
+        corner[j] = min((size_t)offset, grid->dims[j] - 2);
+        fraction[j] = min(offset - corner[j], 1.0);
+    }
+}
+
+static void splat(DensityGrid *grid, const double *color, double count) {
+/*----------------------------------------------------------------------------
+   Adds a color to a density grid, spread over the 8 cells around it.
+
+   @params
+   grid - The density grid.
+   color - The color, in CIELab space.
+   count - The number of pixels of that color.
+-----------------------------------------------------------------------------*/
+    size_t corner[3];
+    double fraction[3];
+    locate(grid, color, corner, fraction);
+
+    for (size_t dz = 0; dz < 2; dz++) {
+        double wz = dz ? fraction[2] : 1 - fraction[2];
+        for (size_t dy = 0; dy < 2; dy++) {
+            double wy = dy ? fraction[1] : 1 - fraction[1];
+            for (size_t dx = 0; dx < 2; dx++) {
+                double wx = dx ? fraction[0] : 1 - fraction[0];
+                size_t c = (
+                    ((corner[2] + dz) * grid->dims[1] + corner[1] + dy) * grid->dims[0] +
+                    corner[0] + dx
+                );
+
+                grid->cells[c] += count * wx * wy * wz;
+            }
+        }
+    }
+}
+
+static double sample(const DensityGrid *grid, const double *color) {
+/*----------------------------------------------------------------------------
+   Samples a density grid at a color, with trilinear interpolation.
+
+   @params
+   grid - The density grid.
+   color - The color, in CIELab space.
+-----------------------------------------------------------------------------*/
+    size_t corner[3];
+    double fraction[3];
+    locate(grid, color, corner, fraction);
+
+    double value = 0;
+    for (size_t dz = 0; dz < 2; dz++) {
+        double wz = dz ? fraction[2] : 1 - fraction[2];
+        for (size_t dy = 0; dy < 2; dy++) {
+            double wy = dy ? fraction[1] : 1 - fraction[1];
+            for (size_t dx = 0; dx < 2; dx++) {
+                double wx = dx ? fraction[0] : 1 - fraction[0];
+                size_t c = (
+                    ((corner[2] + dz) * grid->dims[1] + corner[1] + dy) * grid->dims[0] +
+                    corner[0] + dx
+                );
+
+                value += grid->cells[c] * wx * wy * wz;
+            }
+        }
+    }
+
+    return value;
+}
+
+static void blur(DensityGrid *grid, size_t axis) {
+/*----------------------------------------------------------------------------
+   Blurs a density grid along an axis, with blur_kernel.
+
+   @params
+   grid - The density grid.
+   axis - The axis.
+-----------------------------------------------------------------------------*/
+    size_t cell_count = grid->dims[0] * grid->dims[1] * grid->dims[2];
+    size_t strides[3] = { 1, grid->dims[0], grid->dims[0] * grid->dims[1] };
+    size_t stride = strides[axis];
+    long length = (long)grid->dims[axis];
+
+    double *blurred = patolette__ARENA_malloc(sizeof(double) * cell_count);
+    for (size_t c = 0; c < cell_count; c++) {
+        long u = (long)(c / stride % grid->dims[axis]);
+
+        double value = 0;
+        for (long t = -blur_radius; t <= blur_radius; t++) {
+            if (u + t >= 0 && u + t < length) {
+                value += blur_kernel[t + blur_radius] * grid->cells[(long)c + t * (long)stride];
+            }
+        }
+
+        blurred[c] = value;
+    }
+
+    patolette__ARENA_free(grid->cells);
+    grid->cells = blurred;
+}
+
+/*----------------------------------------------------------------------------
+   Internal functions END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Exported functions START
+-----------------------------------------------------------------------------*/
+
+patolette__Weights *patolette__DENSITY_weights(
+    const patolette__Matrix2D *colors,
+    size_t width,
+    size_t height,
+    double tile_size
+) {
+/*----------------------------------------------------------------------------
+   Weights an image's colors by their rarity in color space.
+
+   @params
+   colors - The image colors, in sRGB[0, 1] space, scanned from left to
+   right, top to bottom.
+   width - The width of the image.
+   height - The height of the image.
+   tile_size - Tile size, greater than 0. The lower, the higher rare
+   colors are weighted.
+
+   @note
+   Weights are in the range [1, 1 + width * height / tile_size ** 2], as
+   for saliency. The rarest colors, making up rare_ratio of the image,
+   get the highest weight. Weights are stored per pixel as 16 bit levels
+   (check patolette__WeightMap).
+-----------------------------------------------------------------------------*/
+    size_t px_count = width * height;
+    size_t levels = (size_t)1 << density_bits;
+    size_t bin_count = levels * levels * levels;
+
+    // Per bin: pixel count and sRGB sums
+    double *bins = patolette__ARENA_calloc(bin_count * 4, sizeof(double));
+    for (size_t i = 0; i < px_count; i++) {
+        double *bin = &bins[4 * get_bin(colors, i, levels)];
+        bin[0] += 1;
+        bin[1] += patolette__Matrix2D_index(colors, i, 0);
+        bin[2] += patolette__Matrix2D_index(colors, i, 1);
+        bin[3] += patolette__Matrix2D_index(colors, i, 2);
+    }
+
+    size_t occupied = 0;
+    for (size_t b = 0; b < bin_count; b++) {
+        occupied += bins[4 * b] > 0;
+    }
+
+    // The mean of each occupied bin, in CIELab
+    patolette__Matrix2D *means = patolette__Matrix2D_init(occupied, 3, NULL);
+    patolette__Vector *counts = patolette__Vector_init(occupied);
+    for (size_t b = 0, k = 0; b < bin_count; b++) {
+        const double *bin = &bins[4 * b];
+        if (bin[0] <= 0) {
+            continue;
+        }
+
+        patolette__COLOR_sRGB_to_CIELab(
+            bin[1] / bin[0],
+            bin[2] / bin[0],
+            bin[3] / bin[0],
+            &patolette__Matrix2D_index(means, k, 0),
+            &patolette__Matrix2D_index(means, k, 1),
+            &patolette__Matrix2D_index(means, k, 2)
+        );
+
+        patolette__Vector_index(counts, k) = bin[0];
+        k++;
+    }
+
+    // A grid spanning the means, padded so that blurring loses nothing
+    double lo[3] = {INFINITY, INFINITY, INFINITY};
+    double hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (size_t k = 0; k < occupied; k++) {
+        for (size_t j = 0; j < 3; j++) {
+            double c = patolette__Matrix2D_index(means, k, j);
+            lo[j] = min(lo[j], c);
+            hi[j] = max(hi[j], c);
+        }
+    }
+
+    DensityGrid grid;
+    for (size_t j = 0; j < 3; j++) {
+        grid.origin[j] = lo[j] - blur_radius * density_cell;
+        grid.dims[j] = (size_t)((hi[j] - lo[j]) / density_cell) + 2 + 2 * blur_radius;
+    }
+
+    grid.cells = patolette__ARENA_calloc(
+        grid.dims[0] * grid.dims[1] * grid.dims[2],
+        sizeof(double)
+    );
+    for (size_t k = 0; k < occupied; k++) {
+        double color[3] = {
+            patolette__Matrix2D_index(means, k, 0),
+            patolette__Matrix2D_index(means, k, 1),
+            patolette__Matrix2D_index(means, k, 2)
+        };
+
+        splat(&grid, color, patolette__Vector_index(counts, k));
+    }
+
+    for (size_t j = 0; j < 3; j++) {
+        blur(&grid, j);
+    }
+
+    // The density around each bin
+    double *densities = patolette__ARENA_malloc(sizeof(double) * occupied);
+    for (size_t k = 0; k < occupied; k++) {
+        double color[3] = {
+            patolette__Matrix2D_index(means, k, 0),
+            patolette__Matrix2D_index(means, k, 1),
+            patolette__Matrix2D_index(means, k, 2)
+        };
+
+        densities[k] = sample(&grid, color);
+    }
+
+    patolette__ARENA_free(grid.cells);
+
+    // Density of the least rare pixel that still gets the full weight
+    RankedBin *ranked = patolette__ARENA_malloc(sizeof(RankedBin) * occupied);
+    for (size_t k = 0; k < occupied; k++) {
+        ranked[k].density = densities[k];
+        ranked[k].count = patolette__Vector_index(counts, k);
+    }
+
+    qsort(ranked, occupied, sizeof(RankedBin), compare_ranked_bins);
+
+    double reference = 0;
+    double rare_count = 0;
+    for (size_t k = 0; k < occupied && rare_count < px_count * rare_ratio; k++) {
+        reference = ranked[k].density;
+        rare_count += ranked[k].count;
+    }
+
+    patolette__ARENA_free(ranked);
+
+    // The 16 bit weight level of each bin. A color's distance to its
+    // neighbours grows as the cube root of 1 / density, and its weight as
+    // the square of that.
+    uint16_t *bin_levels = patolette__ARENA_calloc(bin_count, sizeof(uint16_t));
+    for (size_t b = 0, k = 0; b < bin_count; b++) {
+        if (bins[4 * b] <= 0) {
+            continue;
+        }
+
+        double s = densities[k] > 0 ? min(cbrt(reference / densities[k]), 1.0) : 1;
+        bin_levels[b] = (uint16_t)(SQ(s) * UINT16_MAX + 0.5);
+        k++;
+    }
+
+    patolette__ARENA_free(densities);
+    patolette__ARENA_free(bins);
+    patolette__Matrix2D_destroy(means);
+    patolette__Vector_destroy(counts);
+
+    patolette__UInt16Array *pixel_levels = patolette__UInt16Array_init(px_count);
+
+    #pragma omp parallel for schedule(static) if (px_count >= parallel_pixels)
+    for (size_t i = 0; i < px_count; i++) {
+        patolette__UInt16Array_index(pixel_levels, i) = bin_levels[get_bin(colors, i, levels)];
+    }
+
+    patolette__ARENA_free(bin_levels);
+
+    patolette__WeightMap map = {0};
+    map.kind = patolette__WeightsUInt16;
+    map.data = pixel_levels->data;
+    map.scale = (double)px_count / SQ(tile_size) / UINT16_MAX;
+    return patolette__Weights_init(&map, width, height, pixel_levels);
+}
+
+/*----------------------------------------------------------------------------
+   Exported functions END
+-----------------------------------------------------------------------------*/
@@ -0,0 +1,893 @@
+#include "saliency/saliency.h"
+
+/*----------------------------------------------------------------------------
+   Saliency based color weights.
+
+   Saliency is estimated as in Minimum Barrier Salient Object Detection
+   at 80 FPS (Zhang et al.): the minimum barrier distance of each pixel
+   to the image border, plus its color contrast against the image's
+   border regions, with a center bias. Salient pixels are then given
+   higher weight for palette generation.
+
+   https://openaccess.thecvf.com/content_iccv_2015/papers/Zhang_Minimum_Barrier_Salient_ICCV_2015_paper.pdf
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Constants START
+-----------------------------------------------------------------------------*/
+
+// Number of raster scans of the minimum barrier distance transform
+static const int mbd_passes = 3;
+
+// Dimensions of the tiles raster scans are split into. Tiles along the
+// same anti-diagonal are independent, so they are scanned in parallel.
+// Tiles are wide so that their rows stream well from memory.
+static const size_t mbd_tile_rows = 32;
+static const size_t mbd_tile_cols = 512;
+
+// Border thickness, as a fraction of the geometric mean of the dimensions
+static const double border_ratio = 0.1;
+
+// Steepness of the sigmoid saliency is finally passed through
+static const float sigmoid_steepness = 10.0f;
+
+// Added to the diagonal of singular border covariances
+static const double covariance_ridge = 1e-4;
+
+// Images below this size are not worth splitting across threads
+static const size_t parallel_pixels = 1 << 16;
+
+/*----------------------------------------------------------------------------
+   Constants END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Declarations START
+-----------------------------------------------------------------------------*/
+
+typedef struct Border {
+    // The region [row_begin, row_end) x [col_begin, col_end) of the image
+    size_t row_begin;
+    size_t row_end;
+    size_t col_begin;
+    size_t col_end;
+
+    // The mean CIELab color of the region
+    float mean[3];
+
+    // The inverse covariance of the region's CIELab colors (row-major)
+    float precision[9];
+} Border;
+
+static inline float blend(bool condition, float a, float b);
+
+static inline void relax(
+    float ix,
+    float u_near,
+    float l_near,
+    float d,
+    float u,
+    float l,
+    float *d_out,
+    float *u_out,
+    float *l_out
+);
+
+static inline void relax_carried(
+    float ix,
+    float d,
+    float u,
+    float l,
+    float *u_near,
+    float *l_near,
+    float *d_out
+);
+
+static void scan_tile(
+    const float *img,
+    float *lower,
+    float *upper,
+    float *dist,
+    size_t cols,
+    size_t x_begin,
+    size_t x_end,
+    size_t y_begin,
+    size_t y_end,
+    float *scratch
+);
+
+static void scan_tile_inv(
+    const float *img,
+    float *lower,
+    float *upper,
+    float *dist,
+    size_t cols,
+    size_t x_begin,
+    size_t x_end,
+    size_t y_begin,
+    size_t y_end,
+    float *scratch
+);
+
+static void raster_scan(
+    const float *img,
+    float *lower,
+    float *upper,
+    float *dist,
+    size_t rows,
+    size_t cols,
+    bool inverse
+);
+
+static void get_barrier_distances(
+    const float *img,
+    float *dist,
+    size_t rows,
+    size_t cols
+);
+
+static void set_border_stats(
+    Border *border,
+    const float *lab,
+    size_t cols,
+    size_t px_count
+);
+
+static inline float get_mahalanobis_distance(
+    const Border *border,
+    float l,
+    float a,
+    float b
+);
+
+static patolette__Vector *get_weights(
+    const patolette__Matrix2D *colors,
+    size_t width,
+    size_t height,
+    double gain
+);
+
+static patolette__Matrix2D *downscale(
+    const patolette__Matrix2D *colors,
+    size_t width,
+    size_t height,
+    size_t factor,
+    size_t *small_width,
+    size_t *small_height
+);
+
+/*----------------------------------------------------------------------------
+   Declarations END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Internal functions START
+-----------------------------------------------------------------------------*/
+
+static inline float blend(bool condition, float a, float b) {
+/*----------------------------------------------------------------------------
+   Selects a if condition holds, b otherwise, without branching.
+
+   @note
+   Plain conditionals get turned into branches around the loads of b,
+   which keeps the loops using them from being vectorized.
+-----------------------------------------------------------------------------*/
+    uint32_t ia, ib;
+    memcpy(&ia, &a, sizeof ia);
+    memcpy(&ib, &b, sizeof ib);
+
+    uint32_t mask = -(uint32_t)condition;
+    uint32_t ir = (ia & mask) | (ib & ~mask);
+
+    float result;
+    memcpy(&result, &ir, sizeof result);
+    return result;
+}
+
+static inline void relax(
+    float ix,
+    float u_near,
+    float l_near,
+    float d,
+    float u,
+    float l,
+    float *d_out,
+    float *u_out,
+    float *l_out
+) {
+/*----------------------------------------------------------------------------
+   Relaxes the barrier distance of a pixel through one of its neighbours.
+
+   @params
+   ix - The intensity of the pixel.
+   u_near - The highest intensity along the best path to the neighbour.
+   l_near - The lowest intensity along the best path to the neighbour.
+   d - The barrier distance of the pixel.
+   u - The highest intensity along the best path to the pixel.
+   l - The lowest intensity along the best path to the pixel.
+   d_out, u_out, l_out - On exit, the relaxed d, u and l.
+
+   @note
+   Relaxing through the neighbour across rows first, then through the
+   one across columns, matches relaxing through both at once and keeping
+   the first of the smallest distances.
+
+   @note
+   Outputs are always written, so that loops over it can be vectorized
+   without masked stores. Check blend.
+-----------------------------------------------------------------------------*/
+    float u_path = max(u_near, ix);
+    float l_path = min(l_near, ix);
+    float b = u_path - l_path;
+
+    bool better = b < d;
+    *d_out = blend(better, b, d);
+    *u_out = blend(better, u_path, u);
+    *l_out = blend(better, l_path, l);
+}
+
+static inline void relax_carried(
+    float ix,
+    float d,
+    float u,
+    float l,
+    float *u_near,
+    float *l_near,
+    float *d_out
+) {
+/*----------------------------------------------------------------------------
+   Relaxes the barrier distance of a pixel through the neighbour scanned
+   right before it, and makes the pixel the next one's neighbour. Check
+   relax.
+
+   @params
+   ix - The intensity of the pixel.
+   d - The barrier distance of the pixel.
+   u - The highest intensity along the best path to the pixel.
+   l - The lowest intensity along the best path to the pixel.
+   u_near - The highest intensity along the best path to the neighbour.
+   On exit, that of the pixel.
+   l_near - The lowest intensity along the best path to the neighbour.
+   On exit, that of the pixel.
+   d_out - On exit, the relaxed d.
+
+   @note
+   This is a serial dependency chain, where a (mostly predictable) branch
+   is cheaper than blending.
+-----------------------------------------------------------------------------*/
+    float u_path = max(*u_near, ix);
+    float l_path = min(*l_near, ix);
+    float b = u_path - l_path;
+
+    if (b < d) {
+        *d_out = b;
+        *u_near = u_path;
+        *l_near = l_path;
+    }
+
+    else {
+        *d_out = d;
+        *u_near = u;
+        *l_near = l;
+    }
+}
+
+static void scan_tile(
+    const float *img,
+    float *lower,
+    float *upper,
+    float *dist,
+    size_t cols,
+    size_t x_begin,
+    size_t x_end,
+    size_t y_begin,
+    size_t y_end,
+    float *scratch
+) {
+/*----------------------------------------------------------------------------
+   Forward (top-left to bottom-right) raster scan of a tile.
+
+   @params
+   img - The intensity image (row-major).
+   lower - The lowest intensity along the best path to each pixel.
+   upper - The highest intensity along the best path to each pixel.
+   dist - The barrier distance of each pixel.
+   cols - The number of columns of the image.
+   x_begin, x_end - The rows of the tile, [x_begin, x_end).
+   y_begin, y_end - The columns of the tile, [y_begin, y_end).
+   scratch - Scratch space for 3 * mbd_tile_cols values.
+-----------------------------------------------------------------------------*/
+    size_t width = y_end - y_begin;
+    float *d_row = scratch;
+    float *u_row = scratch + mbd_tile_cols;
+    float *l_row = scratch + 2 * mbd_tile_cols;
+
+    for (size_t x = x_begin; x < x_end; x++) {
+        size_t row = x * cols + y_begin;
+
+        // Through the neighbour above. That row is final, so this vectorizes.
+        #pragma omp simd
+        for (size_t k = 0; k < width; k++) {
+            size_t p = row + k;
+            relax(
+                img[p], upper[p - cols], lower[p - cols],
+                dist[p], upper[p], lower[p],
+                &d_row[k], &u_row[k], &l_row[k]
+            );
+        }
+
+        // Through the left neighbour, carried along in registers
+        float u_near = upper[row - 1];
+        float l_near = lower[row - 1];
+        for (size_t k = 0; k < width; k++) {
+            size_t p = row + k;
+            relax_carried(img[p], d_row[k], u_row[k], l_row[k], &u_near, &l_near, &dist[p]);
+            upper[p] = u_near;
+            lower[p] = l_near;
+        }
+    }
+}
+
+static void scan_tile_inv(
+    const float *img,
+    float *lower,
+    float *upper,
+    float *dist,
+    size_t cols,
+    size_t x_begin,
+    size_t x_end,
+    size_t y_begin,
+    size_t y_end,
+    float *scratch
+) {
+/*----------------------------------------------------------------------------
+   Backward (bottom-right to top-left) raster scan of a tile. Check
+   scan_tile.
+-----------------------------------------------------------------------------*/
+    size_t width = y_end - y_begin;
+    float *d_row = scratch;
+    float *u_row = scratch + mbd_tile_cols;
+    float *l_row = scratch + 2 * mbd_tile_cols;
+
+    for (size_t x = x_end; x-- > x_begin;) {
+        size_t row = x * cols + y_begin;
+
+        // Through the neighbour below. That row is final, so this vectorizes.
+        #pragma omp simd
+        for (size_t k = 0; k < width; k++) {
+            size_t p = row + k;
+            relax(
+                img[p], upper[p + cols], lower[p + cols],
+                dist[p], upper[p], lower[p],
+                &d_row[k], &u_row[k], &l_row[k]
+            );
+        }
+
+        // Through the right neighbour, carried along in registers
+        float u_near = upper[row + width];
+        float l_near = lower[row + width];
+        for (size_t k = width; k-- > 0;) {
+            size_t p = row + k;
+            relax_carried(img[p], d_row[k], u_row[k], l_row[k], &u_near, &l_near, &dist[p]);
+            upper[p] = u_near;
+            lower[p] = l_near;
+        }
+    }
+}
+
+static void raster_scan(
+    const float *img,
+    float *lower,
+    float *upper,
+    float *dist,
+    size_t rows,
+    size_t cols,
+    bool inverse
+) {
+/*----------------------------------------------------------------------------
+   Raster scan of the minimum barrier distance transform, forward
+   (top-left to bottom-right) or backward (bottom-right to top-left).
+
+   The image is split into tiles, scanned in waves along anti-diagonals.
+   A pixel only depends on the two neighbours it is relaxed through, so
+   results match those of a single, serial scan.
+
+   @params
+   img - The intensity image (rows * cols, row-major).
+   lower - The lowest intensity along the best path to each pixel.
+   upper - The highest intensity along the best path to each pixel.
+   dist - The barrier distance of each pixel.
+   rows - The number of rows.
+   cols - The number of columns.
+   inverse - Whether to scan backward.
+
+   @note
+   Backward scans stop short of the second row and column, as the
+   original implementation did.
+-----------------------------------------------------------------------------*/
+    size_t x_begin = inverse ? 2 : 1;
+    size_t y_begin = inverse ? 2 : 1;
+    size_t x_end = rows - 1;
+    size_t y_end = cols - 1;
+
+    size_t tile_rows = (x_end - x_begin + mbd_tile_rows - 1) / mbd_tile_rows;
+    size_t tile_cols = (y_end - y_begin + mbd_tile_cols - 1) / mbd_tile_cols;
+    size_t wave_count = tile_rows + tile_cols - 1;
+
+    #pragma omp parallel if (rows * cols >= parallel_pixels)
+    {
+        float *scratch = patolette__ARENA_malloc(3 * mbd_tile_cols * sizeof(float));
+
+        for (size_t k = 0; k < wave_count; k++) {
+            size_t first = k < tile_cols ? 0 : k - tile_cols + 1;
+            size_t last = min(k, tile_rows - 1);
+
+            #pragma omp for schedule(dynamic)
+            for (size_t i = first; i <= last; i++) {
+                size_t j = k - i;
+
+                if (inverse) {
+                    // Tiles count from the bottom-right corner
+                    size_t x1 = x_end - i * mbd_tile_rows;
+                    size_t y1 = y_end - j * mbd_tile_cols;
+                    size_t x0 = x1 - x_begin > mbd_tile_rows ? x1 - mbd_tile_rows : x_begin;
+                    size_t y0 = y1 - y_begin > mbd_tile_cols ? y1 - mbd_tile_cols : y_begin;
+                    scan_tile_inv(img, lower, upper, dist, cols, x0, x1, y0, y1, scratch);
+                }
+
+                else {
+                    size_t x0 = x_begin + i * mbd_tile_rows;
+                    size_t y0 = y_begin + j * mbd_tile_cols;
+                    size_t x1 = min(x0 + mbd_tile_rows, x_end);
+                    size_t y1 = min(y0 + mbd_tile_cols, y_end);
+                    scan_tile(img, lower, upper, dist, cols, x0, x1, y0, y1, scratch);
+                }
+            }
+        }
+
+        patolette__ARENA_free(scratch);
+    }
+}
+
+static void get_barrier_distances(
+    const float *img,
+    float *dist,
+    size_t rows,
+    size_t cols
+) {
+/*----------------------------------------------------------------------------
+   Approximates the minimum barrier distance of each pixel to the image
+   border with alternating raster scans.
+
+   @params
+   img - The intensity image (rows * cols, row-major). Both dimensions
+   must be greater than 3.
+   dist - On exit, the barrier distance of each pixel.
+   rows - The number of rows.
+   cols - The number of columns.
+-----------------------------------------------------------------------------*/
+    size_t px_count = rows * cols;
+
+    float *lower = patolette__ARENA_malloc(px_count * sizeof(float));
+    float *upper = patolette__ARENA_malloc(px_count * sizeof(float));
+    memcpy(lower, img, px_count * sizeof(float));
+    memcpy(upper, img, px_count * sizeof(float));
+
+    for (size_t x = 0; x < rows; x++) {
+        bool edge = x == 0 || x == rows - 1;
+        for (size_t y = 0; y < cols; y++) {
+            dist[x * cols + y] = edge || y == 0 || y == cols - 1 ? 0 : INFINITY;
+        }
+    }
+
+    // Alternating, starting backward, as the original implementation did
+    for (int k = 0; k < mbd_passes; k++) {
+        raster_scan(img, lower, upper, dist, rows, cols, k % 2 == 0);
+    }
+
+    patolette__ARENA_free(upper);
+    patolette__ARENA_free(lower);
+}
+
+static void set_border_stats(
+    Border *border,
+    const float *lab,
+    size_t cols,
+    size_t px_count
+) {
+/*----------------------------------------------------------------------------
+   Computes the mean and inverse covariance of a border region's colors.
+
+   @params
+   border - The border region.
+   lab - The CIELab image, as three planes of px_count values.
+   cols - The number of columns of the image.
+   px_count - The number of pixels of the image.
+
+   @note
+   Covariance is unbiased (n - 1). Singular covariances, e.g. from flat
+   borders, get a small ridge added so they can be inverted.
+-----------------------------------------------------------------------------*/
+    double n = 0;
+    double s[3] = {0, 0, 0};
+    double ss[6] = {0, 0, 0, 0, 0, 0};
+
+    for (size_t x = border->row_begin; x < border->row_end; x++) {
+        for (size_t y = border->col_begin; y < border->col_end; y++) {
+            size_t p = x * cols + y;
+            double c0 = lab[p];
+            double c1 = lab[px_count + p];
+            double c2 = lab[2 * px_count + p];
+
+            n += 1;
+            s[0] += c0;
+            s[1] += c1;
+            s[2] += c2;
+            ss[0] += c0 * c0;
+            ss[1] += c0 * c1;
+            ss[2] += c0 * c2;
+            ss[3] += c1 * c1;
+            ss[4] += c1 * c2;
+            ss[5] += c2 * c2;
+        }
+    }
+
+    double m[3] = {s[0] / n, s[1] / n, s[2] / n};
+
+    double dof = n > 1 ? n - 1 : 1;
+    double a = (ss[0] - n * m[0] * m[0]) / dof;
+    double b = (ss[1] - n * m[0] * m[1]) / dof;
+    double c = (ss[2] - n * m[0] * m[2]) / dof;
+    double d = (ss[3] - n * m[1] * m[1]) / dof;
+    double e = (ss[4] - n * m[1] * m[2]) / dof;
+    double f = (ss[5] - n * m[2] * m[2]) / dof;
+
+    // Cofactors of | a b c |
+    //              | b d e |
+    //              | c e f |
+    double det;
+    double k[6];
+    for (int attempt = 0; attempt < 2; attempt++) {
+        k[0] = d * f - e * e;
+        k[1] = c * e - b * f;
+        k[2] = b * e - c * d;
+        k[3] = a * f - c * c;
+        k[4] = b * c - a * e;
+        k[5] = a * d - b * b;
+        det = a * k[0] + b * k[1] + c * k[2];
+
+        if (det > patolette__DELTA) {
+            break;
+        }
+
+        a += covariance_ridge;
+        d += covariance_ridge;
+        f += covariance_ridge;
+    }
+
+    for (int j = 0; j < 3; j++) {
+        border->mean[j] = (float)m[j];
+    }
+
+    float *P = border->precision;
+    P[0] = (float)(k[0] / det);
+    P[1] = P[3] = (float)(k[1] / det);
+    P[2] = P[6] = (float)(k[2] / det);
+    P[4] = (float)(k[3] / det);
+    P[5] = P[7] = (float)(k[4] / det);
+    P[8] = (float)(k[5] / det);
+}
+
+static inline float get_mahalanobis_distance(
+    const Border *border,
+    float l,
+    float a,
+    float b
+) {
+/*----------------------------------------------------------------------------
+   Gets the Mahalanobis distance of a CIELab color to a border region's
+   color distribution.
+
+   @params
+   border - The border region.
+   l - L coordinate.
+   a - a coordinate.
+   b - b coordinate.
+-----------------------------------------------------------------------------*/
+    const float *P = border->precision;
+    float v0 = l - border->mean[0];
+    float v1 = a - border->mean[1];
+    float v2 = b - border->mean[2];
+
+    float q = (
+        P[0] * v0 * v0 +
+        P[4] * v1 * v1 +
+        P[8] * v2 * v2 +
+        2.0f * (P[1] * v0 * v1 + P[2] * v0 * v2 + P[5] * v1 * v2)
+    );
+
+    return q > 0 ? sqrtf(q) : 0;
+}
+
+static patolette__Vector *get_weights(
+    const patolette__Matrix2D *colors,
+    size_t width,
+    size_t height,
+    double gain
+) {
+/*----------------------------------------------------------------------------
+   Weights an image's colors by saliency. Check patolette__SALIENCY_weights.
+
+   @params
+   colors - The image colors, in sRGB[0, 1] space, scanned from left to
+   right, top to bottom.
+   width - The width of the image.
+   height - The height of the image.
+   gain - The weight of the most salient colors, besides the base 1.
+-----------------------------------------------------------------------------*/
+    size_t rows = height;
+    size_t cols = width;
+    size_t px_count = rows * cols;
+
+    size_t thickness = (size_t)floor(border_ratio * sqrt((double)px_count));
+    if (rows <= 3 || cols <= 3 || thickness == 0 || thickness >= min(rows, cols)) {
+        return NULL;
+    }
+
+    float *img = patolette__ARENA_malloc(px_count * sizeof(float));
+    float *lab = patolette__ARENA_malloc(3 * px_count * sizeof(float));
+    float *sal = patolette__ARENA_malloc(px_count * sizeof(float));
+
+    // Intensity and CIELab color of each pixel
+    #pragma omp parallel for schedule(static) if (px_count >= parallel_pixels)
+    for (size_t p = 0; p < px_count; p++) {
+        double r = patolette__Matrix2D_index(colors, p, 0);
+        double g = patolette__Matrix2D_index(colors, p, 1);
+        double b = patolette__Matrix2D_index(colors, p, 2);
+        img[p] = (float)((r + g + b) / 3.0);
+
+        double L, A, B;
+        patolette__COLOR_sRGB_to_CIELab(r, g, b, &L, &A, &B);
+        lab[p] = (float)L;
+        lab[px_count + p] = (float)A;
+        lab[2 * px_count + p] = (float)B;
+    }
+
+    get_barrier_distances(img, sal, rows, cols);
+
+    // Top, bottom, left and right regions. Far ones skip the outermost
+    // row / column, as the original implementation did.
+    Border borders[4] = {
+        {0, thickness, 0, cols},
+        {rows - thickness - 1, rows - 1, 0, cols},
+        {0, rows, 0, thickness},
+        {0, rows, cols - thickness - 1, cols - 1}
+    };
+
+    for (int k = 0; k < 4; k++) {
+        set_border_stats(&borders[k], lab, cols, px_count);
+    }
+
+    // Maxima used for normalization
+    float max_mbd = 0;
+    float max_u0 = 0, max_u1 = 0, max_u2 = 0, max_u3 = 0;
+
+    #pragma omp parallel for schedule(static) reduction(max:max_mbd,max_u0,max_u1,max_u2,max_u3) if (px_count >= parallel_pixels)
+    for (size_t p = 0; p < px_count; p++) {
+        float l = lab[p];
+        float a = lab[px_count + p];
+        float b = lab[2 * px_count + p];
+        float u0 = get_mahalanobis_distance(&borders[0], l, a, b);
+        float u1 = get_mahalanobis_distance(&borders[1], l, a, b);
+        float u2 = get_mahalanobis_distance(&borders[2], l, a, b);
+        float u3 = get_mahalanobis_distance(&borders[3], l, a, b);
+        max_mbd = max(max_mbd, sal[p]);
+        max_u0 = max(max_u0, u0);
+        max_u1 = max(max_u1, u1);
+        max_u2 = max(max_u2, u2);
+        max_u3 = max(max_u3, u3);
+    }
+
+    float scale_mbd = max_mbd > 0 ? 1.0f / max_mbd : 0;
+    float scale_u[4] = {
+        max_u0 > 0 ? 1.0f / max_u0 : 0,
+        max_u1 > 0 ? 1.0f / max_u1 : 0,
+        max_u2 > 0 ? 1.0f / max_u2 : 0,
+        max_u3 > 0 ? 1.0f / max_u3 : 0
+    };
+
+    // Border contrast: sum of the normalized distances to all borders but
+    // the farthest one. Written over the intensity image.
+    float *contrast = img;
+    float max_contrast = 0;
+
+    #pragma omp parallel for schedule(static) reduction(max:max_contrast) if (px_count >= parallel_pixels)
+    for (size_t p = 0; p < px_count; p++) {
+        float l = lab[p];
+        float a = lab[px_count + p];
+        float b = lab[2 * px_count + p];
+
+        float sum = 0;
+        float farthest = 0;
+        for (int k = 0; k < 4; k++) {
+            float u = get_mahalanobis_distance(&borders[k], l, a, b) * scale_u[k];
+            sum += u;
+            farthest = max(farthest, u);
+        }
+
+        contrast[p] = sum - farthest;
+        max_contrast = max(max_contrast, contrast[p]);
+    }
+
+    float scale_contrast = max_contrast > 0 ? 1.0f / max_contrast : 0;
+
+    // Center bias. Normalizing the combined saliency before applying it
+    // is skipped, as the result is normalized right after anyway.
+    float half_rows = rows / 2.0f;
+    float half_cols = cols / 2.0f;
+    float inv_radius = 1.0f / sqrtf(SQ(half_rows) + SQ(half_cols));
+    float max_sal = 0;
+
+    #pragma omp parallel for schedule(static) reduction(max:max_sal) if (px_count >= parallel_pixels)
+    for (size_t x = 0; x < rows; x++) {
+        float dx = SQ((float)x - half_rows);
+        for (size_t y = 0; y < cols; y++) {
+            size_t p = x * cols + y;
+            float bias = 1.0f - sqrtf(dx + SQ((float)y - half_cols)) * inv_radius;
+            float s = (sal[p] * scale_mbd + contrast[p] * scale_contrast) * bias;
+            sal[p] = s;
+            max_sal = max(max_sal, s);
+        }
+    }
+
+    float scale_sal = max_sal > 0 ? 1.0f / max_sal : 0;
+
+    patolette__Vector *weights = patolette__Vector_init(px_count);
+
+    #pragma omp parallel for schedule(static) if (px_count >= parallel_pixels)
+    for (size_t p = 0; p < px_count; p++) {
+        float s = 1.0f / (1.0f + expf(-sigmoid_steepness * (sal[p] * scale_sal - 0.5f)));
+        patolette__Vector_index(weights, p) = 1.0 + SQ((double)s) * gain;
+    }
+
+    patolette__ARENA_free(sal);
+    patolette__ARENA_free(lab);
+    patolette__ARENA_free(img);
+
+    return weights;
+}
+
+static patolette__Matrix2D *downscale(
+    const patolette__Matrix2D *colors,
+    size_t width,
+    size_t height,
+    size_t factor,
+    size_t *small_width,
+    size_t *small_height
+) {
+/*----------------------------------------------------------------------------
+   Downscales an image by an integer factor (box filter). Each pixel of
+   the result is the mean of a factor x factor block (smaller at the
+   edges).
+
+   @params
+   colors - The image colors, scanned from left to right, top to bottom.
+   width - The width of the image.
+   height - The height of the image.
+   factor - The downscaling factor.
+   small_width - On exit, the width of the result.
+   small_height - On exit, the height of the result.
+-----------------------------------------------------------------------------*/
+    size_t w = (width + factor - 1) / factor;
+    size_t h = (height + factor - 1) / factor;
+
+    patolette__Matrix2D *small = patolette__Matrix2D_init(w * h, 3, NULL);
+
+    #pragma omp parallel for schedule(static) if (width * height >= parallel_pixels)
+    for (size_t sy = 0; sy < h; sy++) {
+        size_t y_end = min((sy + 1) * factor, height);
+        for (size_t sx = 0; sx < w; sx++) {
+            size_t x_end = min((sx + 1) * factor, width);
+            double sums[3] = {0, 0, 0};
+            double count = 0;
+
+            for (size_t y = sy * factor; y < y_end; y++) {
+                for (size_t x = sx * factor; x < x_end; x++) {
+                    size_t i = y * width + x;
+                    sums[0] += patolette__Matrix2D_index(colors, i, 0);
+                    sums[1] += patolette__Matrix2D_index(colors, i, 1);
+                    sums[2] += patolette__Matrix2D_index(colors, i, 2);
+                    count += 1;
+                }
+            }
+
+            size_t k = sy * w + sx;
+            patolette__Matrix2D_index(small, k, 0) = sums[0] / count;
+            patolette__Matrix2D_index(small, k, 1) = sums[1] / count;
+            patolette__Matrix2D_index(small, k, 2) = sums[2] / count;
+        }
+    }
+
+    *small_width = w;
+    *small_height = h;
+    return small;
+}
+
+/*----------------------------------------------------------------------------
+   Internal functions END
+-----------------------------------------------------------------------------*/
+
+
+/*----------------------------------------------------------------------------
+   Exported functions START
+-----------------------------------------------------------------------------*/
+
+patolette__Weights *patolette__SALIENCY_weights(
+    const patolette__Matrix2D *colors,
+    size_t width,
+    size_t height,
+    double tile_size,
+    size_t max_side
+) {
+/*----------------------------------------------------------------------------
+   Weights an image's colors by saliency.
+
+   @params
+   colors - The image colors, in sRGB[0, 1] space, scanned from left to
+   right, top to bottom.
+   width - The width of the image.
+   height - The height of the image.
+   tile_size - Tile size, greater than 0. The lower, the higher salient
+   colors are weighted.
+   max_side - When > 0, saliency is estimated on a copy of the image
+   downscaled by an integer factor to at most this many pixels on its
+   longer side, and the weights are evaluated by bilinearly sampling
+   the low resolution ones (never expanded to full resolution).
+
+   @note
+   Weights are in the range [1, 1 + width * height / tile_size ** 2].
+   Returns NULL if the (downscaled) image is too small for saliency
+   estimation, i.e. either dimension is at most 3, or the border regions
+   don't fit in it.
+-----------------------------------------------------------------------------*/
+    double gain = (double)(width * height) / SQ(tile_size);
+
+    size_t side = max(width, height);
+    if (max_side == 0 || side <= max_side) {
+        patolette__Vector *weights = get_weights(colors, width, height, gain);
+        return weights == NULL ? NULL : patolette__Weights_from_vector(weights);
+    }
+
+    size_t factor = (side + max_side - 1) / max_side;
+    size_t small_width, small_height;
+    patolette__Matrix2D *small = downscale(
+        colors,
+        width,
+        height,
+        factor,
+        &small_width,
+        &small_height
+    );
+
+    patolette__Vector *small_weights = get_weights(small, small_width, small_height, gain);
+    patolette__Matrix2D_destroy(small);
+
+    if (small_weights == NULL) {
+        return NULL;
+    }
+
+    patolette__WeightMap map = {0};
+    map.kind = patolette__WeightsGrid;
+    map.data = small_weights->data;
+    map.grid_width = small_width;
+    map.grid_height = small_height;
+    map.grid_cell_size = (double)factor;
+    return patolette__Weights_init(&map, width, height, small_weights);
+}
+
+/*----------------------------------------------------------------------------
+   Exported functions END
+-----------------------------------------------------------------------------*/
@@ -4,6 +4,13 @@ from typing import Tuple, Optional
 ColorSpace_CIELuv: int
 ColorSpace_ICtCp: int
 ColorSpace_sRGB: int
+KMeansEngine_FAISS: int
+KMeansEngine_Hamerly: int
+KMeansEngine_MiniBatch: int
+NNEngine_FLANN: int
+NNEngine_Native: int
+Weighting_Density: int
+Weighting_Saliency: int
 
 def quantize(
     width: int,
@@ -13,9 +20,20 @@ def quantize(
     dither: Optional[bool],
     palette_only: Optional[bool],
     color_space: Optional[int],
+    weighting: Optional[int],
     tile_size: Optional[float],
+    saliency_max_side: Optional[int],
     kmeans_niter: Optional[int],
+    kmeans_engine: Optional[int],
+    kmeans_tolerance: Optional[float],
+    kmeans_batch_size: Optional[int],
     kmeans_max_samples: Optional[int],
+    split_batch_ratio: Optional[float],
+    generation_max_samples: Optional[int],
+    pyramid_max_pixels: Optional[int],
+    histogram_bits: Optional[int],
+    target_distortion: Optional[float],
+    nn_engine: Optional[int],
     verbose: Optional[bool]
 ) -> int:
     """
@@ -39,24 +57,79 @@ def quantize(
         The color space to use for quantization. Only used for palette
         generation; dithering is always performed in Linear Rec2020,
         nearest neighbour mapping (when dithering is disabled) in ICtCp. Default: *ICtCp*
+    :param weighting:
+        How colors are weighted when tile_size > 0. *Weighting_Saliency* computes a saliency
+        map, so visually striking areas are given higher weight; *Weighting_Density* gives colors
+        that are rare in color space higher weight. It needs no spatial processing, just a color
+        histogram, so it is much cheaper, especially on large images. Default: *Weighting_Saliency*
     :param tile_size:
             Tile size in the range [0, inf]. When tile_size > 0 is specified,
-            a saliency map is computed, and visually striking areas are given
-            higher weight. The lower the tile size, the more exaggerated the effect. Default: *512*
+            colors are weighted as per *weighting*. The lower the tile size,
+            the more exaggerated the effect. Default: *512*
+    :param saliency_max_side:
+        When > 0, the saliency map is computed on a copy of the image downscaled (by an integer
+        factor) to at most this many pixels on its longer side, and its weights are bilinearly
+        upsampled. Much faster on large images, at the cost of finer detail. *0* computes it at
+        full resolution. Default: *0*
     :param kmeans_niter:
         Number of Kmeans refinment iterations to perform. Anything <= 0 yields no KMeans
         refinement. Default: *32*
+    :param kmeans_engine:
+        The KMeans engine to use for refinement. *KMeansEngine_FAISS* runs FAISS (brute force
+        assignment); *KMeansEngine_Hamerly* runs a native engine that uses distance bounds to skip
+        most distance computations, and is much faster for large palettes; *KMeansEngine_MiniBatch*
+        runs mini-batch KMeans (*kmeans_niter* batches of *kmeans_batch_size* samples), followed by
+        one full iteration, for huge palettes and inputs. *None* picks *KMeansEngine_FAISS*, or
+        *KMeansEngine_Hamerly* if the library was built without FAISS. Default: *None*
+    :param kmeans_tolerance:
+        When > 0, KMeans refinement stops early once the relative objective improvement, or the
+        largest center shift (in the color space used for palette generation), of an iteration is
+        at most this. Anything <= 0 runs all *kmeans_niter* iterations. The mini-batch engine only
+        checks the center shift. Default: *0*
+    :param kmeans_batch_size:
+        Number of samples in each batch, for the mini-batch KMeans engine. Default: *1024*
     :param kmeans_max_samples:
         Maximum number of samples to use when performing KMeans refinement. There's a hard minimum
         of 256 ** 2. Default: *512 ** 2*
+    :param split_batch_ratio:
+        Fraction of the remaining palette budget to split at once in each round of local
+        quantization, in the range [0, 1]. Anything <= 0 splits one cluster at a time (exact
+        greedy order). Higher values are faster for large palettes, at some cost in quality. Default: *0*
+    :param generation_max_samples:
+        Maximum number of colors to generate the palette from. Larger images are sampled (spatially
+        stratified) down to about this many colors, and the full image is then mapped / dithered
+        against the resulting palette. Bounds palette generation time regardless of resolution.
+        Anything <= 0 uses all colors. Default: *0*
+    :param pyramid_max_pixels:
+        Pixel budget for palette generation. Larger images are downscaled by factors of 2 (box
+        filter, in linear light) until under budget, and the palette is generated there. KMeans
+        refinement, if any, is then warm-started from that palette at full resolution. Anything
+        <= 0 disables downscaling. Default: *0*
+    :param histogram_bits:
+        When > 0, colors are binned into a 3D histogram with this many bits per axis (clamped to
+        [5, 7]) in the generation color space, and the palette is generated from the occupied bins
+        as weighted colors. Bins keep their second moments, so cluster distortions stay exact.
+        They only keep their total spread though, not its direction, so split axes are those of
+        the bin means. Bounds palette generation work by the number of occupied bins. Anything
+        <= 0 disables binning. Default: *0*
+    :param target_distortion:
+        When > 0, cluster splitting stops as soon as the mean (weighted) squared error of the
+        palette, in the color space used for palette generation, is at most this, so the palette
+        may end up smaller than *palette_size*. KMeans refinement then runs on the resulting size,
+        which is the length of the returned palette. Anything <= 0 disables it. Default: *0*
+    :param nn_engine:
+        The nearest neighbour engine to use for palette mapping and dithering. *NNEngine_FLANN*
+        runs FLANN (KD-tree); *NNEngine_Native* runs an exact search over palette colors sorted by
+        norm. *None* picks *NNEngine_FLANN*, or *NNEngine_Native* if the library was built without
+        FLANN. Default: *None*
     :param verbose:
         Whether to print progress to console. Default: *false*
     :return out:
         - out[0]: Success flag.
 
-        - out[1]: A (palette_size, 3) array describing the generated color palette in *sRGB[0, 1]* space.
-            The array entries may not all be relveant, e.g *width* * *height* < *palette_size*. Non-relevant
-            entries take the value of an out-of-range *sRGB* color, i.e [-1, -1, -1].
+        - out[1]: A (n, 3) array describing the generated color palette in *sRGB[0, 1]* space, where
+            n <= *palette_size* is the resulting palette size. It may be smaller than *palette_size*, e.g
+            *width* * *height* < *palette_size*, or *target_distortion* was reached with fewer colors.
 
         - out[2]: A (width * height) array mapping each entry in *colors* to an entry in *out[1]*.
         